@@ -0,0 +1,77 @@
+/* arena.c
+ *
+ * Bump-pointer arenas for short-lived scratch memory
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * An arena hands out memory by advancing a cursor through a chain of
+ * buddy blocks and never frees individual allocations. arena_reset()
+ * rewinds the cursor to the first chunk in one step, keeping the chunks
+ * for the next round, so a component that resets once per tick pays
+ * nothing for its temporaries after the first few frames.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel.h"
+
+#define ARENA_CHUNK_ORDER 2  // 16 KB per chunk unless one allocation needs more
+#define ARENA_ALIGN 8
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t capacity;         // Usable bytes after the header
+    size_t used;
+    int order;
+};
+
+#define CHUNK_HEADER_SIZE ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static struct arena_chunk *chunk_create(size_t min_size) {
+    int order = ARENA_CHUNK_ORDER;
+    while (order < MAX_ORDER && ((size_t)PAGE_SIZE << order) - CHUNK_HEADER_SIZE < min_size) order++;
+    if (((size_t)PAGE_SIZE << order) - CHUNK_HEADER_SIZE < min_size) return NULL;
+
+    struct arena_chunk *c = kalloc_pages(order);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->capacity = ((size_t)PAGE_SIZE << order) - CHUNK_HEADER_SIZE;
+    c->used = 0;
+    c->order = order;
+    return c;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) size = ARENA_ALIGN;
+
+    struct arena_chunk *c = a->current;
+    // Move on through chunks kept from earlier rounds before growing
+    while (c && c->capacity - c->used < size) {
+        c = c->next;
+        if (c) c->used = 0;
+    }
+
+    if (!c) {
+        c = chunk_create(size);
+        if (!c) return NULL;
+        if (a->current) {
+            // Every chunk we kept was too small for this, append at the end
+            struct arena_chunk *tail = a->current;
+            while (tail->next) tail = tail->next;
+            tail->next = c;
+        } else {
+            a->head = c;
+        }
+    }
+
+    a->current = c;
+    void *p = (uint8_t *)c + CHUNK_HEADER_SIZE + c->used;
+    c->used += size;
+    return p;
+}
+
+void arena_reset(struct arena *a) {
+    a->current = a->head;
+    if (a->head) a->head->used = 0;
+}
@@ -0,0 +1,268 @@
+/* bench.c
+ *
+ * Microbenchmark component for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * Only linked into "make bench" builds. Once the rest of the system is
+ * up it times the hot primitives with rdtsc, prints one line per case
+ * over COM1:
+ *
+ *   BENCH <name> <cycles/op> <ops>
+ *
+ * and powers QEMU off through the isa-debug-exit device. Every case runs
+ * BENCH_ROUNDS times and reports the fastest round, which filters out
+ * the odd timer IRQ landing in the middle.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define BENCH_ROUNDS 5
+#define DEBUG_EXIT_PORT 0xF4
+#define DEBUG_EXIT_SUCCESS 0x10   // QEMU exits with (0x10 << 1) | 1 = 33
+
+#define SYNTH_TAR_FILES 900
+#define SYNTH_TAR_ORDER 8         // 1 MB, enough for 900 one-block files
+
+static int bench_done = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static void report(const char *name, uint64_t best, uint32_t ops) {
+    char buf[32];
+    serial_write("BENCH ");
+    serial_write(name);
+    serial_write(" ");
+    itoa_u(div_u64(best, ops), buf);
+    serial_write(buf);
+    serial_write(" ");
+    itoa_u(ops, buf);
+    serial_write(buf);
+    serial_write("\n");
+}
+
+// Run fn(ops) BENCH_ROUNDS times and report the fastest per-op cost
+static void run_case(const char *name, void (*fn)(uint32_t), uint32_t ops) {
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint64_t start = rdtsc();
+        fn(ops);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) best = cycles;
+    }
+    report(name, best, ops);
+}
+
+/* Graphics */
+
+static void bench_fill_rect(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) vga_fill_rect(10, 10, 100, 100, (uint8_t)i);
+}
+
+static void bench_draw_string(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++)
+        vga_draw_string(0, 96, "The quick brown fox jumps over the dog", (uint8_t)i);
+}
+
+static void bench_redraw_desktop(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) gui_desktop_redraw();
+}
+
+static void bench_flush(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) {
+        vga_mark_dirty(0, 0, vga_get_width(), vga_get_height());
+        vga_flush();
+    }
+}
+
+// Sweep the pointer diagonally; each step erases and repaints the sprite
+static void bench_cursor_move(uint32_t ops) {
+    vga_cursor_show(1);
+    for (uint32_t i = 0; i < ops; i++) vga_cursor_move(i % 200, i % 150);
+}
+
+/* Page allocator */
+
+static void bench_page_pair(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) kfree_page(kalloc_page());
+}
+
+static void bench_page_pair_nozero(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) kfree_page(kalloc_page_nozero());
+}
+
+// Hold pages until only (100 - percent)% of what was free remains free.
+// The held pages are chained through their first word.
+static void *fill_memory(uint64_t free_at_start, int percent) {
+    void *held = NULL;
+    uint64_t target = free_at_start - div_u64(free_at_start * percent, 100);
+    while (get_free_pages() > target) {
+        void **page = kalloc_page_nozero();
+        if (!page) break;
+        *page = held;
+        held = page;
+    }
+    return held;
+}
+
+static void release_memory(void *held) {
+    while (held) {
+        void *next = *(void **)held;
+        kfree_page(held);
+        held = next;
+    }
+}
+
+static void bench_pages(void) {
+    static const int levels[] = { 0, 50, 90 };
+    static const char *pair_names[] = {
+        "kalloc_page+kfree_page@0%", "kalloc_page+kfree_page@50%", "kalloc_page+kfree_page@90%"
+    };
+    static const char *nozero_names[] = {
+        "kalloc_page_nozero+kfree_page@0%", "kalloc_page_nozero+kfree_page@50%",
+        "kalloc_page_nozero+kfree_page@90%"
+    };
+
+    uint64_t free_at_start = get_free_pages();
+    for (int i = 0; i < 3; i++) {
+        void *held = fill_memory(free_at_start, levels[i]);
+        run_case(pair_names[i], bench_page_pair, 1000);
+        run_case(nozero_names[i], bench_page_pair_nozero, 1000);
+        release_memory(held);
+    }
+}
+
+/* Filesystem */
+
+#define LOOKUP_NAMES 16
+static char lookup_names[LOOKUP_NAMES][128];
+static int lookup_count = 0;
+
+static void bench_lookup_hit(uint32_t ops) {
+    uint8_t *data;
+    uint32_t size;
+    for (uint32_t i = 0; i < ops; i++) {
+        if (fs_read_file(lookup_names[i % lookup_count], &data, &size)) fs_release_file(data);
+    }
+}
+
+static void bench_lookup_miss(uint32_t ops) {
+    uint8_t *data;
+    uint32_t size;
+    for (uint32_t i = 0; i < ops; i++) fs_read_file("no/such/file.txt", &data, &size);
+}
+
+static uint8_t *synth_tar;
+static uint32_t synth_tar_size;
+
+static void write_octal(char *dst, int len, uint32_t v) {
+    dst[len - 1] = 0;
+    for (int i = len - 2; i >= 0; i--) {
+        dst[i] = '0' + (v & 7);
+        v >>= 3;
+    }
+}
+
+static void put_str(char *dst, const char *src) {
+    while (*src) *dst++ = *src++;
+}
+
+// SYNTH_TAR_FILES one-block files spread over 30 directories
+static int build_synth_tar(void) {
+    synth_tar = kalloc_pages(SYNTH_TAR_ORDER);
+    if (!synth_tar) return 0;
+
+    uint8_t *p = synth_tar;
+    for (int i = 0; i < SYNTH_TAR_FILES; i++) {
+        char *h = (char *)p;
+        char num[16];
+        put_str(h, "dir");
+        itoa_u(i % 30, num);
+        str_append(h, num);
+        str_append(h, "/file");
+        itoa_u(i, num);
+        str_append(h, num);
+        str_append(h, ".txt");
+
+        write_octal(h + 100, 8, 0644);   // mode
+        write_octal(h + 124, 12, 64);    // size
+        h[156] = '0';                    // regular file
+        put_str(h + 257, "ustar");
+        h[263] = '0';
+        h[264] = '0';
+        put_str((char *)p + 512, "synthetic benchmark payload");
+        p += 1024;
+    }
+    synth_tar_size = (uint32_t)(p - synth_tar) + 1024;  // Two zero blocks end it
+    return 1;
+}
+
+static void bench_parse_tar(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) {
+        fs_set_initrd(synth_tar, synth_tar_size);
+        fs_wait_ready();
+    }
+}
+
+static void bench_fs(void) {
+    fs_wait_ready();
+    int count = fs_get_file_count();
+    for (int i = 0; i < count && lookup_count < LOOKUP_NAMES; i++) {
+        uint32_t size;
+        int is_dir;
+        if (fs_get_file_info(i, lookup_names[lookup_count], &size, &is_dir) && !is_dir)
+            lookup_count++;
+    }
+    if (lookup_count > 0) run_case("fs_read_file_hit", bench_lookup_hit, 10000);
+    run_case("fs_read_file_miss", bench_lookup_miss, 10000);
+
+    if (!build_synth_tar()) {
+        serial_write("BENCH parse_tar skipped (out of memory)\n");
+        return;
+    }
+    run_case("parse_tar_900_files", bench_parse_tar, 1);
+
+    // Put the real initrd back in case we keep running
+    const struct boot_module *initrd = multiboot_get_module(0);
+    if (initrd) {
+        fs_set_initrd((uint8_t *)initrd->start, initrd->end - initrd->start);
+        fs_wait_ready();
+    }
+    kfree_pages(synth_tar, SYNTH_TAR_ORDER);
+}
+
+static void bench_tick(void) {
+    if (bench_done) return;
+    bench_done = 1;
+
+    serial_write("BENCH start\n");
+
+    // Measure drawing, not waiting for the retrace
+    vga_set_vsync(0);
+    run_case("vga_fill_rect_100x100", bench_fill_rect, 1000);
+    run_case("vga_draw_string_38ch", bench_draw_string, 1000);
+    run_case("redraw_desktop", bench_redraw_desktop, 100);
+    run_case("vga_flush_full", bench_flush, 100);
+    run_case("vga_cursor_move", bench_cursor_move, 1000);
+    vga_set_vsync(1);
+    gui_desktop_redraw();
+    vga_flush();
+
+    bench_pages();
+    bench_fs();
+
+    serial_write("BENCH done\n");
+    outb(DEBUG_EXIT_PORT, DEBUG_EXIT_SUCCESS);  // No-op without isa-debug-exit
+}
+
+__attribute__((section(".compobjs"))) static struct component bench_component = {
+    .name = "bench",
+    .init = NULL,
+    .tick = bench_tick,
+    .period_ms = 1000
+};
+
+__attribute__((section(".comps"))) struct component *p_bench_component = &bench_component;
@@ -29,8 +29,6 @@ static int cursor_x = 0, cursor_y = 0;
 static char command_buffer[64];
 static size_t command_len = 0;
 
-extern int keyboard_has_key(void);
-extern char keyboard_get_key(void);
 extern uint64_t get_free_pages(void);
 
 static void draw_box(int x, int y, int w, int h, uint8_t color) {
@@ -320,10 +318,13 @@ static void desktop_tick(void) {
         draw_desktop();
     }
     
-    // Handle keyboard input every tick
-    if (keyboard_has_key()) {
-        char c = keyboard_get_key();
-        
+    // Handle one typed character per tick, skipping other input events
+    struct input_event ev;
+    char c = 0;
+    while (!c && input_read(&ev, 1) == 1) {
+        if (ev.type == INPUT_KEY_DOWN) c = ev.ascii;
+    }
+    if (c) {
         if (c == '\n') {
             handle_command();
             draw_desktop(); // Redraw immediately after command
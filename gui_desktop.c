@@ -3,6 +3,11 @@
  * Graphical desktop environment with window manager
  * Copyright (C) 2025 B."Nova" J.
  * Licensed under GNU GPLv2
+ *
+ * Nothing is redrawn wholesale: every change records the screen area it
+ * affects as damage, and the compositor repaints only the damaged
+ * rectangles, back to front through the z-order, skipping windows that
+ * are completely hidden by one above them.
  */
 
 #include <stdint.h>
@@ -11,6 +16,23 @@
 #define MAX_WINDOWS 8
 #define TASKBAR_HEIGHT 16
 #define TITLEBAR_HEIGHT 12
+#define SCREEN_WIDTH vga_get_width()    // Set by the graphics backend at init
+#define SCREEN_HEIGHT vga_get_height()
+#define MAX_DAMAGE_RECTS 8
+#define LINE_HEIGHT 10  // Same leading as vga_draw_text_block()
+#define INPUT_BATCH 32
+
+// Frame pacing: damage is presented at most GUI_TARGET_FPS times a second
+#ifndef GUI_TARGET_FPS
+#define GUI_TARGET_FPS 60
+#endif
+#define FRAME_MS (1000 / GUI_TARGET_FPS)
+#define FRAME_HIST_BUCKETS 12
+#define FRAME_HIST_SHIFT 14      // Bucket 0 is everything under 2^15 cycles
+#define CHART_HEIGHT 36
+#define CHART_BAR_PITCH 20
+#define PERF_REFRESH_MS 1000
+#define CLOSE_BUTTON_X 12   // Close button: 10x8 at (width - 12, 2)
 
 // Color palette (VGA 256 colors)
 #define COLOR_DESKTOP_BG 0x01    // Dark blue
@@ -22,25 +44,156 @@
 #define COLOR_BUTTON 0x07        // Light gray
 #define COLOR_TEXT 0x00          // Black
 
+// One display list entry. Coordinates are relative to the window's
+// content origin, so moving a window never invalidates its list.
+#define DL_TEXT 1  // w / 8 characters of content starting at off
+#define DL_RECT 2  // Filled w x h rect
+
+typedef struct {
+    uint8_t kind;
+    uint8_t color;
+    int16_t x, y;
+    uint16_t w, h;
+    uint32_t off;
+} DisplayOp;
+
 typedef struct {
-    int active;
     int x, y;
     int width, height;
     char title[32];
-    char content[512];
+    const char *content;  // Text to draw; either owned or a string literal
+    char *owned;          // kmalloc()'d buffer backing content, if any
+
+    // content, laid out once by layout_content() and replayed by
+    // draw_window(); kmalloc()'d, op_count entries in use
+    DisplayOp *ops;
+    uint32_t op_count;
+    uint32_t op_cap;
+
+    // File viewer: shows data[0, size) straight out of tarfs, one line
+    // per row starting at line top. Line start offsets are indexed only
+    // as far as something has asked for.
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t *lines;      // kmalloc()'d, line_count entries in use
+    uint32_t line_count;
+    uint32_t line_cap;
+    uint32_t indexed;     // data[0, indexed) has been scanned for lines
+    uint32_t top;
 } GUIWindow;
 
-static GUIWindow windows[MAX_WINDOWS];
+typedef struct {
+    int x0, y0, x1, y1;  // Half-open: [x0, x1) x [y0, y1)
+} Rect;
+
+// Window slots; NULL is free. The windows themselves come from a slab cache
+static GUIWindow *windows[MAX_WINDOWS];
+static struct kmem_cache *window_cache;
+
+// Scratch memory for text built while handling input, reset every tick
+static struct arena frame_arena;
 static int active_window = -1;
 static int tick_counter = 0;
-static int needs_redraw = 1;
-static int file_browser_open = 0;  // Track if file browser is open
+static int perf_window = -1;       // Perf window, refreshed every PERF_REFRESH_MS
+static uint64_t perf_refresh_ms = 0;
+
+// Render time (composite + flush) of every presented frame, log2 buckets
+static uint64_t next_frame_ms = 0;
+static uint32_t frame_hist[FRAME_HIST_BUCKETS];
+static uint32_t frame_count = 0;
+static uint64_t frame_max = 0;
+static uint64_t vsync_wait_max = 0;  // Kept out of the frame times
+static int file_browser = -1;      // Window showing the file list, if open
+static int file_browser_partial = 0;  // It was filled in before indexing finished
+
+// Stacking order, bottom to top; the active window is always on top
+static int z_order[MAX_WINDOWS];
+static int z_count = 0;
+
+// Pointer state as of the last input event handled
+static int pointer_x = 0;
+static int pointer_y = 0;
+static uint8_t pointer_buttons = 0;
+static int pointer_moved = 0;     // pointer_x/y changed since the last apply_pointer()
+
+// Title bar drag in progress, or -1
+static int drag_window = -1;
+static int drag_dx, drag_dy;      // Pointer offset from the window origin
+
+// Screen areas that must be repainted on the next composite()
+static Rect damage[MAX_DAMAGE_RECTS];
+static int damage_count = 0;
+static Rect painting;  // The damage rect composite() is repainting now
 
 extern void vga_clear_screen(uint8_t color);
 extern void vga_fill_rect(int x, int y, int w, int h, uint8_t color);
 extern void vga_draw_rect(int x, int y, int w, int h, uint8_t color);
 extern void vga_draw_string(int x, int y, const char *str, uint8_t color);
 extern void vga_draw_char(int x, int y, char c, uint8_t color);
+extern void vga_draw_chars(int x, int y, const char *s, int n, uint8_t color);
+extern void vga_draw_text_block(int x, int y, int w, int h, const char *text, uint8_t color);
+
+// Text assembled in the frame arena, growing by doubling
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} TextBuf;
+
+static size_t str_len(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static void text_append_n(TextBuf *t, const char *src, size_t n) {
+    if (t->len + n + 1 > t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 128;
+        while (cap < t->len + n + 1) cap *= 2;
+        char *buf = arena_alloc(&frame_arena, cap);
+        if (!buf) return;
+        for (size_t i = 0; i < t->len; i++) buf[i] = t->buf[i];
+        t->buf = buf;
+        t->cap = cap;
+    }
+    for (size_t i = 0; i < n; i++) t->buf[t->len++] = src[i];
+    t->buf[t->len] = 0;
+}
+
+static void text_append(TextBuf *t, const char *src) {
+    text_append_n(t, src, str_len(src));
+}
+
+static void text_append_u(TextBuf *t, uint64_t v) {
+    char num[32];
+    itoa_u(v, num);
+    text_append(t, num);
+}
+
+// Right-align text in a column of the given width
+static void text_append_column(TextBuf *t, const char *src, size_t width) {
+    size_t len = str_len(src);
+    while (len < width) {
+        text_append(t, " ");
+        width--;
+    }
+    text_append(t, src);
+}
+
+// Cycle counts shortened to fit a 6-character column
+static void text_append_cycles(TextBuf *t, uint64_t cycles) {
+    char num[32];
+    const char *suffix = "";
+    if (cycles >= 100000000) {
+        cycles = div_u64(cycles, 1000000);
+        suffix = "M";
+    } else if (cycles >= 100000) {
+        cycles = div_u64(cycles, 1000);
+        suffix = "k";
+    }
+    itoa_u(cycles, num);
+    str_append(num, suffix);
+    text_append_column(t, num, 6);
+}
 
 // Helper function to append string safely
 static void safe_append(char *dest, const char *src, int max) {
@@ -53,6 +206,146 @@ static void safe_append(char *dest, const char *src, int max) {
     dest[len] = 0;
 }
 
+static Rect window_rect(const GUIWindow *w) {
+    Rect r = { w->x, w->y, w->x + w->width, w->y + w->height };
+    return r;
+}
+
+static int rect_intersect(const Rect *a, const Rect *b, Rect *out) {
+    out->x0 = a->x0 > b->x0 ? a->x0 : b->x0;
+    out->y0 = a->y0 > b->y0 ? a->y0 : b->y0;
+    out->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+    out->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+    return out->x0 < out->x1 && out->y0 < out->y1;
+}
+
+static int rect_contains(const Rect *outer, const Rect *inner) {
+    return outer->x0 <= inner->x0 && outer->y0 <= inner->y0 &&
+           outer->x1 >= inner->x1 && outer->y1 >= inner->y1;
+}
+
+static void rect_union(Rect *dst, const Rect *src) {
+    if (src->x0 < dst->x0) dst->x0 = src->x0;
+    if (src->y0 < dst->y0) dst->y0 = src->y0;
+    if (src->x1 > dst->x1) dst->x1 = src->x1;
+    if (src->y1 > dst->y1) dst->y1 = src->y1;
+}
+
+static int rect_area(const Rect *r) {
+    return (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+// Mark a screen area for repaint
+static void damage_rect(int x, int y, int w, int h) {
+    Rect screen = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    Rect in = { x, y, x + w, y + h };
+    Rect r;
+    if (!rect_intersect(&in, &screen, &r)) return;
+
+    // Merge with anything overlapping so no pixel is painted twice
+    int merged = 1;
+    while (merged) {
+        merged = 0;
+        for (int i = 0; i < damage_count; i++) {
+            Rect tmp;
+            if (rect_intersect(&damage[i], &r, &tmp)) {
+                rect_union(&r, &damage[i]);
+                damage[i] = damage[--damage_count];
+                merged = 1;
+                break;
+            }
+        }
+    }
+
+    if (damage_count < MAX_DAMAGE_RECTS) {
+        damage[damage_count++] = r;
+        return;
+    }
+
+    int best = 0;
+    int best_growth = 0x7FFFFFFF;
+    for (int i = 0; i < damage_count; i++) {
+        Rect u = damage[i];
+        rect_union(&u, &r);
+        int growth = rect_area(&u) - rect_area(&damage[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    rect_union(&damage[best], &r);
+}
+
+static void damage_window(int idx) {
+    if (idx < 0 || idx >= MAX_WINDOWS || !windows[idx]) return;
+    GUIWindow *w = windows[idx];
+    damage_rect(w->x, w->y, w->width, w->height);
+}
+
+static void damage_taskbar(void) {
+    damage_rect(0, SCREEN_HEIGHT - TASKBAR_HEIGHT, SCREEN_WIDTH, TASKBAR_HEIGHT);
+}
+
+// Keep a window on screen and above the taskbar
+static void clamp_window(GUIWindow *w) {
+    if (w->x + w->width > SCREEN_WIDTH) w->x = SCREEN_WIDTH - w->width;
+    if (w->y + w->height > SCREEN_HEIGHT - TASKBAR_HEIGHT)
+        w->y = SCREEN_HEIGHT - TASKBAR_HEIGHT - w->height;
+    if (w->y < 0) w->y = 0;
+    if (w->x < 0) w->x = 0;
+}
+
+static void z_remove(int idx) {
+    int j = 0;
+    for (int i = 0; i < z_count; i++) {
+        if (z_order[i] != idx) z_order[j++] = z_order[i];
+    }
+    z_count = j;
+}
+
+// Make a window active and raise it to the top of the stack
+static void set_active_window(int idx) {
+    if (idx == active_window) return;
+    damage_window(active_window);  // Title bar color changes
+    active_window = idx;
+    if (idx >= 0) {
+        z_remove(idx);
+        z_order[z_count++] = idx;
+        damage_window(idx);
+    }
+    damage_taskbar();
+}
+
+static void move_window(int idx, int dx, int dy) {
+    GUIWindow *w = windows[idx];
+    int old_x = w->x, old_y = w->y;
+    w->x += dx;
+    w->y += dy;
+    clamp_window(w);
+    if (w->x == old_x && w->y == old_y) return;
+
+    // Only the union of the old and new footprint changes
+    damage_rect(old_x, old_y, w->width, w->height);
+    damage_window(idx);
+}
+
+static void close_window(int idx) {
+    if (idx == file_browser) file_browser = -1;
+    if (idx == perf_window) perf_window = -1;
+    if (drag_window == idx) drag_window = -1;
+    damage_window(idx);
+    fs_release_file(windows[idx]->data);
+    kfree(windows[idx]->owned);
+    kfree(windows[idx]->lines);
+    kfree(windows[idx]->ops);
+    kmem_cache_free(window_cache, windows[idx]);
+    windows[idx] = NULL;
+    z_remove(idx);
+    active_window = -1;
+    set_active_window(z_count > 0 ? z_order[z_count - 1] : -1);
+    damage_taskbar();
+}
+
 // Draw a box
 static void draw_box(int x, int y, int w, int h, uint8_t color) {
     vga_fill_rect(x, y, w, h, color);
@@ -62,65 +355,249 @@ static void draw_box(int x, int y, int w, int h, uint8_t color) {
 // Create a new window
 static int create_window(const char *title, int x, int y, int w, int h) {
     for (int i = 0; i < MAX_WINDOWS; i++) {
-        if (!windows[i].active) {
-            windows[i].active = 1;
-            windows[i].x = x;
-            windows[i].y = y;
-            windows[i].width = w;
-            windows[i].height = h;
+        if (!windows[i]) {
+            GUIWindow *win = kmem_cache_alloc(window_cache);
+            if (!win) return -1;
+            windows[i] = win;
+            win->x = x;
+            win->y = y;
+            win->width = w;
+            win->height = h;
             
             int j = 0;
             while (title[j] && j < 31) {
-                windows[i].title[j] = title[j];
+                win->title[j] = title[j];
                 j++;
             }
-            windows[i].title[j] = 0;
-            windows[i].content[0] = 0;
+            win->title[j] = 0;
+            clamp_window(win);
             
-            active_window = i;
+            set_active_window(i);
             return i;
         }
     }
     return -1;
 }
 
-// Set window content
+static int add_op(GUIWindow *w, const DisplayOp *op) {
+    if (w->op_count == w->op_cap) {
+        uint32_t cap = w->op_cap ? w->op_cap * 2 : 16;
+        DisplayOp *ops = krealloc(w->ops, cap * sizeof(DisplayOp));
+        if (!ops) return 0;
+        w->ops = ops;
+        w->op_cap = cap;
+    }
+    w->ops[w->op_count++] = *op;
+    return 1;
+}
+
+static void add_text_run(GUIWindow *w, int x, int y, uint32_t off, int n) {
+    if (n <= 0) return;
+    DisplayOp op = { DL_TEXT, COLOR_TEXT, x, y, n * 8, 8, off };
+    add_op(w, &op);
+}
+
+// Break content into one text run per visual line, wrapping at the box
+// width and on '\n' and stopping at the first line that would cross the
+// bottom edge, like vga_draw_text_block() does
+static void layout_content(GUIWindow *w) {
+    w->op_count = 0;
+    if (!w->content) return;
+
+    int max_chars = (w->width - 8) / 8;
+    int max_y = w->height - TITLEBAR_HEIGHT - 8;
+    if (max_chars <= 0) return;
+
+    const char *text = w->content;
+    uint32_t start = 0;
+    int y = 0;
+    for (uint32_t i = 0; y + 8 <= max_y; i++) {
+        int n = i - start;
+        if (text[i] == '\n' || text[i] == 0 || n == max_chars) {
+            add_text_run(w, 0, y, start, n);
+            if (text[i] == 0) break;
+            y += LINE_HEIGHT;
+            start = text[i] == '\n' ? i + 1 : i;
+            if (text[i] != '\n') i--;  // This character starts the next line
+        }
+    }
+}
+
+static int ops_equal(const DisplayOp *a, const char *a_text,
+                     const DisplayOp *b, const char *b_text) {
+    if (a->kind != b->kind || a->color != b->color || a->x != b->x || a->y != b->y ||
+        a->w != b->w || a->h != b->h) return 0;
+    if (a->kind != DL_TEXT) return 1;
+    for (int i = 0; i < a->w / 8; i++) {
+        if (a_text[a->off + i] != b_text[b->off + i]) return 0;
+    }
+    return 1;
+}
+
+static void damage_op(const GUIWindow *w, const DisplayOp *op) {
+    damage_rect(w->x + 4 + op->x, w->y + TITLEBAR_HEIGHT + 4 + op->y, op->w, op->h);
+}
+
+// Swap in new content and relayout, then append any extra ops such as
+// chart bars. Only the ops that changed are damaged, so refreshing a
+// list repaints just the lines that differ. Anything old_owned pointed
+// at is freed once the diff is done.
+static void replace_content(int idx, const char *content, char *owned,
+                            const DisplayOp *extra, uint32_t extra_count) {
+    GUIWindow *w = windows[idx];
+    const char *old_content = w->content;
+    char *old_owned = w->owned;
+    DisplayOp *old_ops = w->ops;
+    uint32_t old_count = w->op_count;
+
+    w->content = content;
+    w->owned = owned;
+    w->ops = NULL;
+    w->op_count = 0;
+    w->op_cap = 0;
+    layout_content(w);
+    for (uint32_t i = 0; i < extra_count; i++) add_op(w, &extra[i]);
+
+    uint32_t n = old_count > w->op_count ? old_count : w->op_count;
+    for (uint32_t i = 0; i < n; i++) {
+        if (i < old_count && i < w->op_count &&
+            ops_equal(&old_ops[i], old_content, &w->ops[i], content)) continue;
+        if (i < old_count) damage_op(w, &old_ops[i]);
+        if (i < w->op_count) damage_op(w, &w->ops[i]);
+    }
+
+    kfree(old_ops);
+    kfree(old_owned);
+}
+
+// Point a window at text that outlives it, such as a literal, without copying
+static void set_window_text(int idx, const char *text) {
+    if (idx < 0 || idx >= MAX_WINDOWS || !windows[idx]) return;
+    replace_content(idx, text, NULL, NULL, 0);
+}
+
+// Copy transient text, e.g. from the frame arena, into the window,
+// followed by extra display ops drawn after the text
+static void set_window_content_ops(int idx, const char *content,
+                                   const DisplayOp *extra, uint32_t extra_count) {
+    if (idx < 0 || idx >= MAX_WINDOWS || !windows[idx]) return;
+    
+    size_t len = str_len(content);
+    char *buf = kmalloc(len + 1);
+    if (!buf) return;
+    for (size_t i = 0; i <= len; i++) buf[i] = content[i];
+    replace_content(idx, buf, buf, extra, extra_count);
+}
+
 static void set_window_content(int idx, const char *content) {
-    if (idx < 0 || idx >= MAX_WINDOWS || !windows[idx].active) return;
+    set_window_content_ops(idx, content, NULL, 0);
+}
+
+// Replay a window's display list, skipping ops outside the rect being painted
+static void draw_ops(const GUIWindow *w) {
+    int ox = w->x + 4;
+    int oy = w->y + TITLEBAR_HEIGHT + 4;
+    for (uint32_t i = 0; i < w->op_count; i++) {
+        const DisplayOp *op = &w->ops[i];
+        Rect r = { ox + op->x, oy + op->y, ox + op->x + op->w, oy + op->y + op->h };
+        Rect tmp;
+        if (!rect_intersect(&r, &painting, &tmp)) continue;
+        if (op->kind == DL_TEXT) {
+            vga_draw_chars(r.x0, r.y0, w->content + op->off, op->w / 8, op->color);
+        } else {
+            vga_fill_rect(r.x0, r.y0, op->w, op->h, op->color);
+        }
+    }
+}
+
+// Show a file in a window without copying it; data must outlive the window
+static void set_window_file(int idx, const uint8_t *data, uint32_t size) {
+    if (idx < 0 || idx >= MAX_WINDOWS || !windows[idx]) return;
     
-    int i = 0;
-    while (content[i] && i < 511) {
-        windows[idx].content[i] = content[i];
-        i++;
+    GUIWindow *w = windows[idx];
+    w->data = data;
+    w->size = size;
+    w->line_count = 0;
+    w->indexed = 0;
+    w->top = 0;
+    damage_window(idx);
+}
+
+// Extend the viewer's line index until it covers line, or the data ends.
+// Returns whether that line exists.
+static int index_lines(GUIWindow *w, uint32_t line) {
+    while (w->line_count <= line && w->indexed < w->size) {
+        if (w->line_count == w->line_cap) {
+            uint32_t cap = w->line_cap ? w->line_cap * 2 : 64;
+            uint32_t *lines = krealloc(w->lines, cap * sizeof(uint32_t));
+            if (!lines) return 0;
+            w->lines = lines;
+            w->line_cap = cap;
+        }
+        w->lines[w->line_count++] = w->indexed;
+        
+        // Skip to the start of the next line
+        while (w->indexed < w->size && w->data[w->indexed++] != '\n');
     }
-    windows[idx].content[i] = 0;
+    return line < w->line_count;
+}
+
+static int viewer_rows(const GUIWindow *w) {
+    return (w->height - TITLEBAR_HEIGHT - 8) / LINE_HEIGHT;
+}
+
+// Draw only the lines that fit; text past the right edge is cut off
+static void draw_viewer(GUIWindow *w, int x, int y) {
+    int cols = (w->width - 8) / 8;
+    int rows = viewer_rows(w);
+    
+    for (int r = 0; r < rows; r++) {
+        uint32_t line = w->top + r;
+        if (!index_lines(w, line)) break;
+        
+        const uint8_t *text = w->data + w->lines[line];
+        uint32_t left = w->size - w->lines[line];
+        int n = 0;
+        while (n < cols && (uint32_t)n < left && text[n] != '\n') n++;
+        if (n > 0 && text[n - 1] == '\r') n--;
+        vga_draw_chars(x, y + r * LINE_HEIGHT, (const char *)text, n, COLOR_TEXT);
+    }
+}
+
+// Scroll a viewer window by delta lines, stopping at either end
+static void scroll_window(int idx, int delta) {
+    GUIWindow *w = windows[idx];
+    if (!w || !w->data) return;
+    
+    uint32_t top = w->top;
+    if (delta < 0) {
+        top = (uint32_t)-delta > top ? 0 : top + delta;
+    } else {
+        top += delta;
+        // Keep at least the last line on screen
+        while (top > w->top && !index_lines(w, top)) top--;
+    }
+    if (top == w->top) return;
+    w->top = top;
+    damage_window(idx);
 }
 
 // Draw a window
 static void draw_window(int idx) {
-    GUIWindow *w = &windows[idx];
-    if (!w->active) return;
-    
-    // Clamp position
-    if (w->y < 0) w->y = 0;
-    if (w->x < 0) w->x = 0;
-    if (w->x + w->width > 320) w->x = 320 - w->width;
-    if (w->y + w->height > 200 - TASKBAR_HEIGHT) 
-        w->y = 200 - TASKBAR_HEIGHT - w->height;
+    GUIWindow *w = windows[idx];
+    if (!w) return;
     
     // Draw title bar
     uint8_t color = (idx == active_window) ? COLOR_TITLEBAR : COLOR_BUTTON;
     vga_fill_rect(w->x, w->y, w->width, TITLEBAR_HEIGHT, color);
     vga_draw_rect(w->x, w->y, w->width, TITLEBAR_HEIGHT, COLOR_BORDER);
     
-    // Draw title
-    int tx = w->x + 4;
-    for (int i = 0; w->title[i] && tx + (i * 8) < w->x + w->width - 16; i++) {
-        vga_draw_char(tx + (i * 8), w->y + 2, w->title[i], COLOR_TITLEBAR_TEXT);
-    }
+    // Draw title (stops short of the close button)
+    vga_draw_text_block(w->x + 4, w->y + 2, w->width - 16, 8,
+                        w->title, COLOR_TITLEBAR_TEXT);
     
     // Draw close button
-    int close_x = w->x + w->width - 12;
+    int close_x = w->x + w->width - CLOSE_BUTTON_X;
     vga_fill_rect(close_x, w->y + 2, 10, 8, COLOR_BUTTON);
     vga_draw_rect(close_x, w->y + 2, 10, 8, COLOR_BORDER);
     vga_draw_char(close_x + 1, w->y + 2, 'X', COLOR_TEXT);
@@ -132,160 +609,292 @@ static void draw_window(int idx) {
                   w->height - TITLEBAR_HEIGHT, COLOR_BORDER);
     
     // Draw content
-    int content_x = w->x + 4;
-    int content_y = w->y + TITLEBAR_HEIGHT + 4;
-    int max_chars = (w->width - 8) / 8;
-    
-    for (int i = 0; w->content[i] && content_y < w->y + w->height - 8; i++) {
-        if (w->content[i] == '\n') {
-            content_y += 10;
-            content_x = w->x + 4;
-        } else {
-            int pos = (content_x - (w->x + 4)) / 8;
-            if (pos < max_chars) {
-                vga_draw_char(content_x, content_y, w->content[i], COLOR_TEXT);
-                content_x += 8;
-            } else {
-                content_y += 10;
-                content_x = w->x + 4;
-                if (content_y < w->y + w->height - 8) {
-                    vga_draw_char(content_x, content_y, w->content[i], COLOR_TEXT);
-                    content_x += 8;
-                }
-            }
-        }
-    }
+    if (w->data) draw_viewer(w, w->x + 4, w->y + TITLEBAR_HEIGHT + 4);
+    else draw_ops(w);
 }
 
 // Draw taskbar
 static void draw_taskbar(void) {
-    vga_fill_rect(0, 200 - TASKBAR_HEIGHT, 320, TASKBAR_HEIGHT, COLOR_TASKBAR);
-    vga_draw_string(4, 200 - TASKBAR_HEIGHT + 4, "OpenComp", COLOR_TITLEBAR_TEXT);
-    vga_draw_string(175, 200 - TASKBAR_HEIGHT + 4, "E:Menu X:Close", COLOR_TITLEBAR_TEXT);
+    int y = SCREEN_HEIGHT - TASKBAR_HEIGHT;
+    vga_fill_rect(0, y, SCREEN_WIDTH, TASKBAR_HEIGHT, COLOR_TASKBAR);
+    vga_draw_string(4, y + 4, "OpenComp", COLOR_TITLEBAR_TEXT);
+    // Right-aligned, 14 characters of 8 pixels plus a small margin
+    vga_draw_string(SCREEN_WIDTH - 14 * 8 - 33, y + 4, "E:Menu X:Close", COLOR_TITLEBAR_TEXT);
     
     if (active_window >= 0) {
         char info[16] = "Win:";
         char num[8];
         itoa_u(active_window + 1, num);
         safe_append(info, num, 16);
-        vga_draw_string(65, 200 - TASKBAR_HEIGHT + 4, info, COLOR_TITLEBAR_TEXT);
+        vga_draw_string(65, y + 4, info, COLOR_TITLEBAR_TEXT);
+    }
+}
+
+// Is r hidden entirely by a window stacked above z position k?
+static int occluded_above(int k, const Rect *r) {
+    for (int j = k + 1; j < z_count; j++) {
+        Rect wr = window_rect(windows[z_order[j]]);
+        if (rect_contains(&wr, r)) return 1;
+    }
+    return 0;
+}
+
+// Repaint every damaged rectangle, back to front
+static void composite(void) {
+    Rect taskbar = { 0, SCREEN_HEIGHT - TASKBAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    for (int d = 0; d < damage_count; d++) {
+        Rect *dr = &damage[d];
+        vga_set_clip(dr->x0, dr->y0, dr->x1 - dr->x0, dr->y1 - dr->y0);
+        painting = *dr;
+
+        // Nothing below the topmost window covering the whole rect shows
+        int first = 0;
+        int covered = 0;
+        for (int k = z_count - 1; k >= 0; k--) {
+            Rect wr = window_rect(windows[z_order[k]]);
+            if (rect_contains(&wr, dr)) {
+                first = k;
+                covered = 1;
+                break;
+            }
+        }
+        if (!covered) {
+            vga_fill_rect(dr->x0, dr->y0, dr->x1 - dr->x0, dr->y1 - dr->y0,
+                          COLOR_DESKTOP_BG);
+        }
+
+        for (int k = first; k < z_count; k++) {
+            Rect wr = window_rect(windows[z_order[k]]);
+            Rect visible;
+            if (!rect_intersect(&wr, dr, &visible)) continue;
+            if (occluded_above(k, &visible)) continue;
+            draw_window(z_order[k]);
+        }
+
+        Rect tmp;
+        if (rect_intersect(&taskbar, dr, &tmp)) draw_taskbar();
     }
+
+    vga_reset_clip();
+    damage_count = 0;
+}
+
+static void record_frame(uint64_t cycles) {
+    if (cycles > frame_max) frame_max = cycles;
+    int b = 0;
+    cycles >>= FRAME_HIST_SHIFT;
+    while (cycles > 1 && b < FRAME_HIST_BUCKETS - 1) {
+        cycles >>= 1;
+        b++;
+    }
+    frame_hist[b]++;
+    frame_count++;
 }
 
 // Redraw everything
 static void redraw_desktop(void) {
-    vga_clear_screen(COLOR_DESKTOP_BG);
+    damage_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    composite();
+}
+
+// Full repaint into the back buffer, for callers outside the desktop
+void gui_desktop_redraw(void) {
+    redraw_desktop();
+}
+
+// (Re)build the file browser's listing. While tarfs is still indexing
+// the count grows; refilling then only repaints the lines that changed.
+static void fill_file_browser(void) {
+    TextBuf t = { 0 };
+    int count = fs_get_file_count();
+    file_browser_partial = !fs_ready();
+    text_append(&t, "File Browser\n\nFiles: ");
+    text_append_u(&t, count);
+    if (file_browser_partial) text_append(&t, " (indexing...)");
+    text_append(&t, "\nPress 1-8 to open\n\n");
     
-    for (int i = 0; i < MAX_WINDOWS; i++) {
-        if (windows[i].active && i != active_window) {
-            draw_window(i);
+    for (int i = 0; i < count && i < 8; i++) {
+        char name[128];
+        uint32_t size;
+        int is_dir;
+        
+        if (fs_get_file_info(i, name, &size, &is_dir)) {
+            text_append_u(&t, i + 1);
+            text_append(&t, ". ");
+            text_append(&t, is_dir ? "[DIR] " : "[   ] ");
+            
+            size_t len = str_len(name);
+            text_append_n(&t, name, len < 24 ? len : 24);
+            text_append(&t, "\n");
         }
     }
     
-    if (active_window >= 0) {
-        draw_window(active_window);
+    if (count > 8) {
+        text_append(&t, "\n...more...");
     }
     
-    draw_taskbar();
+    if (t.buf) set_window_content(file_browser, t.buf);
 }
 
-// Handle keyboard
-static void handle_keyboard(void) {
-    if (!keyboard_has_key()) return;
-    
-    char key = keyboard_get_key();
+// Frame time histogram, drawn as bars under the component table
+static void append_frame_chart(TextBuf *t, DisplayOp *bars) {
+    text_append(t, "Frames ");
+    char num[32];
+    itoa_u(frame_count, num);
+    text_append_column(t, num, 6);
+    text_append(t, "  max");
+    text_append_cycles(t, frame_max);
+    if (vga_vsync_available()) {
+        text_append(t, " vsync");
+        text_append_cycles(t, vsync_wait_max);
+        text_append(t, "\n");
+    } else {
+        text_append(t, "  timer\n");
+    }
+
+    // The bars go in the blank lines; count down to them
+    int top = 0;
+    for (size_t i = 0; i < t->len; i++) top += t->buf[i] == '\n';
+    top *= LINE_HEIGHT;
+    text_append(t, "\n\n\n\n");
+
+    uint32_t peak = 1;
+    for (int b = 0; b < FRAME_HIST_BUCKETS; b++)
+        if (frame_hist[b] > peak) peak = frame_hist[b];
+    for (int b = 0; b < FRAME_HIST_BUCKETS; b++) {
+        // Any non-empty bucket gets at least a one pixel bar
+        int h = frame_hist[b] ? 1 + (frame_hist[b] * (CHART_HEIGHT - 1)) / peak : 0;
+        DisplayOp bar = { DL_RECT, COLOR_TITLEBAR, b * CHART_BAR_PITCH,
+                          top + CHART_HEIGHT - h, CHART_BAR_PITCH - 4, h, 0 };
+        bars[b] = bar;
+    }
+
+    // Bucket b holds frames of [2^(b + SHIFT), 2^(b + SHIFT + 1)) cycles
+    text_append(t, "<");
+    text_append_cycles(t, 1ull << (FRAME_HIST_SHIFT + 1));
+    text_append_column(t, "", 16);
+    text_append_cycles(t, 1ull << (FRAME_HIST_SHIFT + FRAME_HIST_BUCKETS - 1));
+    text_append(t, "+");
+}
+
+static void fill_perf_window(void) {
+    TextBuf t = { 0 };
+    text_append(&t, "Cycles   calls   min   avg   max\n");
     
+    int count = kernel_component_count();
+    for (int i = 0; i < count; i++) {
+        const struct component *c = kernel_get_component(i);
+        if (!c || !c->name) continue;
+        
+        size_t len = str_len(c->name);
+        text_append_n(&t, c->name, len < 9 ? len : 9);
+        while (len++ < 9) text_append(&t, " ");
+        
+        const struct component_stats *st = &c->stats;
+        if (!c->tick) {
+            text_append(&t, " init");
+            text_append_cycles(&t, st->init_cycles);
+        } else if (st->tick_calls == 0) {
+            text_append(&t, "    0");
+        } else {
+            char num[32];
+            itoa_u(st->tick_calls, num);
+            text_append_column(&t, num, 5);
+            text_append_cycles(&t, st->tick_min);
+            // div_u64 takes a 32-bit divisor, so halve both sides until the
+            // call count fits instead of letting it truncate (possibly to 0)
+            uint64_t total = st->tick_cycles, calls = st->tick_calls;
+            while (calls >> 32) {
+                total >>= 1;
+                calls >>= 1;
+            }
+            text_append_cycles(&t, div_u64(total, (uint32_t)calls));
+            text_append_cycles(&t, st->tick_max);
+        }
+        text_append(&t, "\n");
+    }
+
+    DisplayOp bars[FRAME_HIST_BUCKETS];
+    append_frame_chart(&t, bars);
+    if (t.buf) set_window_content_ops(perf_window, t.buf, bars, FRAME_HIST_BUCKETS);
+    perf_refresh_ms = timer_get_ms() + PERF_REFRESH_MS;
+}
+
+// Handle one key press
+static void handle_key(char key) {
     // Tab - switch windows
     if (key == '\t') {
-        int start = active_window;
+        if (z_count == 0) return;
+        int next = active_window;
         do {
-            active_window++;
-            if (active_window >= MAX_WINDOWS) active_window = 0;
-            if (windows[active_window].active) break;
-        } while (active_window != start);
-        needs_redraw = 1;
+            next++;
+            if (next >= MAX_WINDOWS) next = 0;
+            if (windows[next]) break;
+        } while (next != active_window);
+        set_active_window(next);
         return;
     }
     
     // X - close window
     if (key == 'x' || key == 'X') {
-        if (active_window >= 0) {
-            // Check if closing file browser
-            if (windows[active_window].title[0] == 'F' && 
-                windows[active_window].title[1] == 'i' &&
-                windows[active_window].title[2] == 'l' &&
-                windows[active_window].title[3] == 'e' &&
-                windows[active_window].title[4] == 's') {
-                file_browser_open = 0;
-            }
-            
-            windows[active_window].active = 0;
-            active_window = -1;
-            for (int i = 0; i < MAX_WINDOWS; i++) {
-                if (windows[i].active) {
-                    active_window = i;
-                    break;
-                }
-            }
-        }
-        needs_redraw = 1;
+        if (active_window >= 0) close_window(active_window);
         return;
     }
     
     if (active_window < 0) return;
-    GUIWindow *w = &windows[active_window];
     
     // WASD - move window
     if (key == 'w' || key == 'W') {
-        w->y -= 5;
-        if (w->y < 0) w->y = 0;
-        needs_redraw = 1;
+        move_window(active_window, 0, -5);
     } else if (key == 's' || key == 'S') {
-        w->y += 5;
-        needs_redraw = 1;
+        move_window(active_window, 0, 5);
     } else if (key == 'a' || key == 'A') {
-        w->x -= 5;
-        if (w->x < 0) w->x = 0;
-        needs_redraw = 1;
+        move_window(active_window, -5, 0);
     } else if (key == 'd' || key == 'D') {
-        w->x += 5;
-        needs_redraw = 1;
+        move_window(active_window, 5, 0);
+    }
+    // JK - scroll a file viewer down/up
+    else if (key == 'j' || key == 'J') {
+        scroll_window(active_window, 1);
+    } else if (key == 'k' || key == 'K') {
+        scroll_window(active_window, -1);
     }
     // E - Start Menu
     else if (key == 'e' || key == 'E') {
         int win = create_window("Start Menu", 10, 140, 140, 90);
         if (win >= 0) {
-            set_window_content(win,
+            set_window_text(win,
                 "Applications:\n\n"
                 "H - Help\n"
                 "M - Memory\n"
                 "F - Files\n"
-                "C - Calculator\n\n"
+                "P - Perf\n"
+                "C - Calculator\n"
                 "Press key to open");
         }
-        needs_redraw = 1;
     }
     // Space - commands
     else if (key == ' ') {
-        int win = create_window("Commands", 80, 60, 160, 100);
+        int win = create_window("Commands", 80, 50, 160, 120);
         if (win >= 0) {
-            set_window_content(win,
+            set_window_text(win,
                 "Keys:\n\n"
                 "Tab - Switch\n"
                 "X - Close\n"
                 "WASD - Move\n"
+                "JK - Scroll file\n"
                 "E - Menu\n"
                 "H - Help\n"
                 "M - Memory\n"
                 "F - Files");
         }
-        needs_redraw = 1;
     }
     // H - Help
     else if (key == 'h' || key == 'H') {
         int win = create_window("Help", 40, 30, 240, 100);
         if (win >= 0) {
-            set_window_content(win,
+            set_window_text(win,
                 "OpenComp Help\n\n"
                 "Tab switches windows\n"
                 "WASD moves windows\n"
@@ -293,75 +902,30 @@ static void handle_keyboard(void) {
                 "E opens menu\n\n"
                 "Press F for files");
         }
-        needs_redraw = 1;
     }
     // M - Memory
     else if (key == 'm' || key == 'M') {
         int win = create_window("Memory", 60, 50, 200, 70);
         if (win >= 0) {
-            char buf[256] = "Memory:\n\nFree: ";
-            char num[32];
-            itoa_u(get_free_pages() * 4, num);
-            safe_append(buf, num, 256);
-            safe_append(buf, " KB\nUsed: ", 256);
-            itoa_u((4096 - get_free_pages()) * 4, num);
-            safe_append(buf, num, 256);
-            safe_append(buf, " KB", 256);
-            set_window_content(win, buf);
+            TextBuf t = { 0 };
+            text_append(&t, "Memory:\n\nFree: ");
+            text_append_u(&t, get_free_pages() * 4);
+            text_append(&t, " KB\nUsed: ");
+            text_append_u(&t, (get_total_pages() - get_free_pages()) * 4);
+            text_append(&t, " KB");
+            if (t.buf) set_window_content(win, t.buf);
         }
-        needs_redraw = 1;
     }
     // F - File browser
     else if (key == 'f' || key == 'F') {
-        file_browser_open = 1;  // Mark file browser as open
         int win = create_window("Files", 30, 20, 260, 140);
         if (win >= 0) {
-            char buf[512] = "File Browser\n\n";
-            char num[16];
-            int count = fs_get_file_count();
-            itoa_u(count, num);
-            safe_append(buf, "Files: ", 512);
-            safe_append(buf, num, 512);
-            safe_append(buf, "\n", 512);
-            safe_append(buf, "Press 1-8 to open\n\n", 512);
-            
-            for (int i = 0; i < count && i < 8; i++) {
-                char name[128];
-                uint32_t size;
-                int is_dir;
-                
-                if (fs_get_file_info(i, name, &size, &is_dir)) {
-                    // Add number
-                    char idx[8];
-                    itoa_u(i + 1, idx);
-                    safe_append(buf, idx, 512);
-                    safe_append(buf, ". ", 512);
-                    
-                    safe_append(buf, is_dir ? "[DIR] " : "[   ] ", 512);
-                    
-                    char short_name[25];
-                    int j = 0;
-                    while (name[j] && j < 24) {
-                        short_name[j] = name[j];
-                        j++;
-                    }
-                    short_name[j] = 0;
-                    
-                    safe_append(buf, short_name, 512);
-                    safe_append(buf, "\n", 512);
-                }
-            }
-            
-            if (count > 8) {
-                safe_append(buf, "\n...more...", 512);
-            }
-            
-            set_window_content(win, buf);
+            file_browser = win;
+            fill_file_browser();
         }
-        needs_redraw = 1;
     }
     // 1-8 keys - open file by number (ONLY if file browser is open)
-    else if ((key >= '1' && key <= '8') && file_browser_open) {
+    else if ((key >= '1' && key <= '8') && file_browser >= 0) {
         int file_idx = key - '1';
         int count = fs_get_file_count();
         
@@ -379,30 +943,16 @@ static void handle_keyboard(void) {
                         uint32_t fsize;
                         
                         if (fs_read_file_by_index(file_idx, &data, &fsize)) {
-                            char content[512];
-                            int i = 0;
-                            // Copy file contents (limit to 500 chars)
-                            while (i < fsize && i < 500 && data[i]) {
-                                content[i] = data[i];
-                                i++;
-                            }
-                            content[i] = 0;
-                            
-                            // Add truncation notice if needed
-                            if (fsize > 500) {
-                                safe_append(content, "\n\n...truncated...", 512);
-                            }
-                            
-                            set_window_content(win, content);
+                            set_window_file(win, data, fsize);
                         } else {
-                            set_window_content(win, "Error: Could not read file");
+                            set_window_text(win, "Error: Could not read file");
                         }
                     }
                 } else {
                     // It's a directory
                     int win = create_window(name, 60, 50, 200, 80);
                     if (win >= 0) {
-                        set_window_content(win, 
+                        set_window_text(win,
                             "Directory\n\n"
                             "Directory browsing\n"
                             "not yet implemented.");
@@ -410,57 +960,172 @@ static void handle_keyboard(void) {
                 }
             }
         }
-        needs_redraw = 1;
+    }
+    // P - Per-component profiling counters and frame times
+    else if (key == 'p' || key == 'P') {
+        int win = create_window("Perf", 8, 10, 304, 170);
+        if (win >= 0) {
+            perf_window = win;
+            fill_perf_window();
+        }
     }
     // C - Calculator
     else if (key == 'c' || key == 'C') {
         int win = create_window("Calculator", 100, 40, 120, 90);
         if (win >= 0) {
-            set_window_content(win,
+            set_window_text(win,
                 "Calculator\n\n"
                 "Coming soon!\n\n"
                 "Will support:\n"
                 "+ - * /");
         }
-        needs_redraw = 1;
+    }
+}
+
+// Topmost window under (x, y), or -1. Walks the stacking order from the
+// top, so at most z_count rects are tested
+static int window_at(int x, int y) {
+    for (int k = z_count - 1; k >= 0; k--) {
+        const GUIWindow *w = windows[z_order[k]];
+        if (x >= w->x && x < w->x + w->width && y >= w->y && y < w->y + w->height)
+            return z_order[k];
+    }
+    return -1;
+}
+
+// Catch the cursor and any dragged window up with the pointer
+static void apply_pointer(void) {
+    if (!pointer_moved) return;
+    pointer_moved = 0;
+    if (drag_window >= 0) {
+        GUIWindow *w = windows[drag_window];
+        move_window(drag_window, pointer_x - drag_dx - w->x, pointer_y - drag_dy - w->y);
+    }
+    vga_cursor_move(pointer_x, pointer_y);
+}
+
+// A left press focuses the window under the pointer, closes it from
+// the close button or starts dragging it by the title bar
+static void handle_press(int x, int y) {
+    int idx = window_at(x, y);
+    if (idx < 0) return;
+    set_active_window(idx);
+
+    GUIWindow *w = windows[idx];
+    int lx = x - w->x;
+    int ly = y - w->y;
+    if (ly >= TITLEBAR_HEIGHT) return;
+    if (lx >= w->width - CLOSE_BUTTON_X && lx < w->width - CLOSE_BUTTON_X + 10 &&
+        ly >= 2 && ly < 10) {
+        close_window(idx);
+        return;
+    }
+    drag_window = idx;
+    drag_dx = lx;
+    drag_dy = ly;
+}
+
+static void handle_input(const struct input_event *ev) {
+    switch (ev->type) {
+        case INPUT_KEY_DOWN:
+            if (ev->ascii) handle_key(ev->ascii);
+            break;
+
+        case INPUT_MOUSE_MOVE:
+            // Moves only record the position; apply_pointer() acts on the
+            // last one, so a frame costs one window move however many came
+            pointer_x = ev->x;
+            pointer_y = ev->y;
+            pointer_moved = 1;
+            break;
+
+        case INPUT_MOUSE_BUTTON: {
+            // The drag has to reach where the button changed first
+            pointer_x = ev->x;
+            pointer_y = ev->y;
+            pointer_moved = 1;
+            apply_pointer();
+
+            uint8_t pressed = ev->buttons & ~pointer_buttons;
+            pointer_buttons = ev->buttons;
+            if (pressed & MOUSE_BUTTON_LEFT) handle_press(ev->x, ev->y);
+            if (!(ev->buttons & MOUSE_BUTTON_LEFT)) drag_window = -1;
+            break;
+        }
     }
 }
 
 // Init
 static void gui_desktop_init(void) {
-    for (int i = 0; i < MAX_WINDOWS; i++) {
-        windows[i].active = 0;
-    }
+    window_cache = kmem_cache_create("gui_window", sizeof(GUIWindow));
     
     int win = create_window("Welcome", 15, 6, 200, 100);
     if (win >= 0) {
-        set_window_content(win,
+        set_window_text(win,
             "OpenComp Desktop\n\n"
             "Press E for menu\n"
             "Press H for help\n\n"
-            "WASD moves windows");
+            "Drag or WASD to move");
     }
     
     win = create_window("System", 20, 80, 160, 80);
     if (win >= 0) {
-        set_window_content(win,
-            "Graphics: 320x200\n"
-            "Mode: VGA 13h\n"
-            "Keyboard: PS/2\n\n"
-            "Press Tab!");
+        TextBuf t = { 0 };
+        text_append(&t, "Graphics: ");
+        text_append_u(&t, SCREEN_WIDTH);
+        text_append(&t, "x");
+        text_append_u(&t, SCREEN_HEIGHT);
+        text_append(&t, vga_get_depth() == 32 ? "\nMode: LFB 32bpp\n" : "\nMode: VGA 13h\n");
+        text_append(&t, "Keyboard: PS/2\n\n"
+                        "Press Tab!");
+        if (t.buf) set_window_content(win, t.buf);
     }
     
-    needs_redraw = 1;
+    redraw_desktop();
+    vga_flush();
+
+    mouse_get_position(&pointer_x, &pointer_y);
+    vga_cursor_move(pointer_x, pointer_y);
+    vga_cursor_show(1);
     puts("[gui_desktop] GUI initialized\n");
 }
 
 // Tick
 static void gui_desktop_tick(void) {
-    handle_keyboard();
-    
-    if (needs_redraw) {
-        redraw_desktop();
-        needs_redraw = 0;
+    arena_reset(&frame_arena);
+
+    // Everything that happened since the last frame, oldest first
+    struct input_event batch[INPUT_BATCH];
+    int n;
+    while ((n = input_read(batch, INPUT_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) handle_input(&batch[i]);
+    }
+    apply_pointer();
+
+    // Catch the file list up with tarfs's incremental indexing
+    if (file_browser >= 0 && file_browser_partial) fill_file_browser();
+
+    uint64_t now = timer_get_ms();
+    if (perf_window >= 0 && now >= perf_refresh_ms) fill_perf_window();
+    if (perf_window >= 0) kernel_wake_at(perf_refresh_ms);
+
+    // Damage piles up until the next frame is due, then goes out in one
+    // present. Too early: ask to be ticked again when the frame is due.
+    if (damage_count > 0 && now < next_frame_ms) {
+        kernel_wake_at(next_frame_ms);
+    } else if (damage_count > 0) {
+        next_frame_ms = now + FRAME_MS;
+
+        trace_mark(TRACE_USER, damage_count);
+        // Render time only: the flush's wait for retrace is not ours
+        uint64_t start = rdtsc();
+        composite();
+        vga_flush();
+        uint64_t elapsed = rdtsc() - start;
+        uint64_t wait = vga_last_vsync_wait();
+        if (wait > elapsed) wait = elapsed;  // Never let the subtraction wrap
+        if (wait > vsync_wait_max) vsync_wait_max = wait;
+        record_frame(elapsed - wait);
     }
     
     tick_counter++;
@@ -469,7 +1134,9 @@ static void gui_desktop_tick(void) {
 __attribute__((section(".compobjs"))) static struct component gui_desktop_component = {
     .name = "gui_desktop",
     .init = gui_desktop_init,
-    .tick = gui_desktop_tick
+    .tick = gui_desktop_tick,
+    .wake_events = EVENT_INPUT | EVENT_TARFS,
+    .deps = (const char *const[]){ "memory", "vga_graphics", "tarfs", NULL }
 };
 
 __attribute__((section(".comps"))) struct component *p_gui_desktop_component = &gui_desktop_component;
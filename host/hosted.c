@@ -0,0 +1,884 @@
+/* hosted.c
+ *
+ * Userspace harness for OpenComp's allocator, tarfs and rasterizer
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * "make host" links memory.c, slab.c, arena.c, tarfs.c and
+ * vga_graphics.c with this file into a Linux executable, so they can be
+ * timed under perf, checked under valgrind or ASan, or fed archives far
+ * bigger than a test ISO would carry:
+ *
+ *   opencomp-host [-m MB] [-f WxH] bench  cycles/op for the hot primitives
+ *   opencomp-host [-m MB] tar [FILE]      parse FILE (or a built-in archive with
+ *                                         long names, plain and OCZ1), check lookups
+ *   opencomp-host [-m MB] fuzz [N] [S]    N random allocator, tar and OCZ rounds
+ *   opencomp-host ring                    check SPSC_RING, then race two threads
+ *
+ * -f hands vga_graphics.c a fake 32bpp linear framebuffer of that size
+ * instead of leaving it in mode 13h.
+ *
+ * Stand-ins for the rest of the kernel live here: "physical memory" is
+ * an mmap at a fixed address below 4GB, reported through a fake
+ * multiboot memory map, and VGA memory and ports are plain arrays.
+ * Components are initialized through their p_*_component pointers in
+ * the same order kernel.c would.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "../kernel.h"
+
+#define HOST_MEMORY_BASE 0x40000000UL  // Page N is still address N * PAGE_SIZE
+#define DEFAULT_MEMORY_MB 64
+
+/* ------------------------------
+   Kernel stand-ins
+   ------------------------------
+*/
+
+// memory.c reserves the kernel image; ours isn't in the fake RAM at all
+uint8_t __kernel_start[1];
+uint8_t __kernel_end[1];
+
+uint8_t host_vram[320 * 200];
+
+static int quiet = 0;
+static struct memory_region host_region;
+static struct boot_framebuffer host_fb;  // addr == 0: no -f given
+
+void kernel_puts(const char *s) {
+    if (!quiet) fputs(s, stdout);
+}
+
+void itoa_u(uint64_t v, char *buf) {
+    sprintf(buf, "%llu", (unsigned long long)v);
+}
+
+void str_append(char *dest, const char *src) {
+    strcat(dest, src);
+}
+
+void kernel_raise_event(uint32_t events) {
+    (void)events;  // Nothing is scheduled; callers run ticks themselves
+}
+
+// One CPU: smp_parallel() just runs the parts in order
+int smp_cpu_count(void) {
+    return 1;
+}
+
+void smp_parallel(smp_work_fn fn, void *arg, int parts) {
+    for (int i = 0; i < parts; i++) fn(arg, i);
+}
+
+uint64_t timer_get_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int multiboot_module_count(void) {
+    return 0;
+}
+
+const struct boot_module *multiboot_get_module(int index) {
+    (void)index;
+    return NULL;
+}
+
+int multiboot_memory_region_count(void) {
+    return 1;
+}
+
+const struct memory_region *multiboot_get_memory_region(int index) {
+    return index == 0 ? &host_region : NULL;
+}
+
+// Without -f there's no framebuffer tag and vga_graphics.c stays in
+// mode 13h on host_vram
+const struct boot_framebuffer *multiboot_get_framebuffer(void) {
+    return host_fb.addr ? &host_fb : NULL;
+}
+
+// An x8r8g8b8 framebuffer like the one QEMU's VBE gives GRUB
+static void fake_framebuffer(uint32_t width, uint32_t height) {
+    host_fb.pitch = width * 4;
+    host_fb.width = width;
+    host_fb.height = height;
+    host_fb.bpp = 32;
+    host_fb.type = FRAMEBUFFER_TYPE_RGB;
+    host_fb.red_pos = 16;
+    host_fb.red_size = 8;
+    host_fb.green_pos = 8;
+    host_fb.green_size = 8;
+    host_fb.blue_pos = 0;
+    host_fb.blue_size = 8;
+    host_fb.addr = (uintptr_t)calloc(height, host_fb.pitch);
+}
+
+// Only vga_graphics.c does port I/O. Report the retrace bit flipping on
+// every read so vga_flush()'s vsync wait falls straight through.
+void host_outb(uint16_t port, uint8_t val) {
+    (void)port;
+    (void)val;
+}
+
+uint8_t host_inb(uint16_t port) {
+    static uint8_t status = 0;
+    if (port == 0x3DA) {
+        status ^= 0x08;
+        return status;
+    }
+    return 0;
+}
+
+extern struct component *p_memory_component;
+extern struct component *p_tarfs_component;
+extern struct component *p_vga_graphics_component;
+
+static void boot(size_t memory_mb) {
+    size_t size = memory_mb * 1024 * 1024;
+    void *ram = mmap((void *)HOST_MEMORY_BASE, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (ram != (void *)HOST_MEMORY_BASE) {
+        fprintf(stderr, "opencomp-host: can't map %zu MB at %#lx\n", memory_mb, HOST_MEMORY_BASE);
+        exit(1);
+    }
+    host_region.base = HOST_MEMORY_BASE;
+    host_region.length = size;
+    host_region.type = MEMORY_AVAILABLE;
+
+    p_memory_component->init();
+    p_tarfs_component->init();
+    p_vga_graphics_component->init();
+}
+
+/* ------------------------------
+   Benchmarks
+   ------------------------------
+*/
+
+#define ROUNDS 5
+
+static void report(const char *name, void (*fn)(uint32_t), uint32_t ops) {
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t start = rdtsc();
+        fn(ops);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) best = cycles;
+    }
+    printf("%-32s %10llu cycles/op  (%u ops)\n", name,
+           (unsigned long long)(best / ops), ops);
+}
+
+static void bench_fill_rect(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) vga_fill_rect(10, 10, 100, 100, (uint8_t)i);
+}
+
+static void bench_draw_string(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++)
+        vga_draw_string(0, 96, "The quick brown fox jumps over the dog", (uint8_t)i);
+}
+
+static void bench_flush(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) {
+        vga_mark_dirty(0, 0, vga_get_width(), vga_get_height());
+        vga_flush();
+    }
+}
+
+// Sweep the pointer diagonally; each step erases and repaints the sprite
+static void bench_cursor_move(uint32_t ops) {
+    vga_cursor_show(1);
+    for (uint32_t i = 0; i < ops; i++) vga_cursor_move(i % 200, i % 150);
+}
+
+static void bench_page_pair(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) kfree_page(kalloc_page());
+}
+
+static void bench_order4_pair(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) kfree_pages(kalloc_pages(4), 4);
+}
+
+static void bench_kmalloc_pair(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) kfree(kmalloc(64));
+}
+
+static uint8_t *tar_image;
+static uint32_t tar_size;
+
+static void bench_parse(uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i++) {
+        fs_set_initrd(tar_image, tar_size);
+        fs_wait_ready();
+    }
+}
+
+static uint32_t tar_fill;
+
+// Append a member at tar_fill; size_field is what the header claims and
+// len what actually follows it
+static void tar_append(const char *name, char type, uint32_t size_field,
+                       const void *data, uint32_t len) {
+    char *h = (char *)tar_image + tar_fill;
+    snprintf(h, 100, "%s", name);  // Longer names are cut, as tar does
+    snprintf(h + 100, 8, "%07o", 0644);
+    snprintf(h + 124, 12, "%011o", size_field);
+    h[156] = type;
+    memcpy(h + 257, "ustar", 5);
+    memcpy(h + 263, "00", 2);
+    memcpy(h + 512, data, len);
+    tar_fill += 512 + (len + 511) / 512 * 512;
+}
+
+// One "<len> <key>=<value>\n" record; len counts its own digits
+static int pax_record(char *out, const char *key, const char *value) {
+    int body = (int)(strlen(key) + strlen(value)) + 3;
+    int len = body + 1;
+    while (len != body + snprintf(NULL, 0, "%d", len)) len = body + snprintf(NULL, 0, "%d", len);
+    return sprintf(out, "%d %s=%s\n", len, key, value);
+}
+
+// Both over the 100 bytes a ustar name field holds
+#define GNU_LONG_NAME "ext/a-directory-name-that-is-long-enough-to-push-the-path-" \
+                      "past-the-ustar-name-field/gnu-long-name.txt"
+#define PAX_LONG_NAME "ext/a-directory-name-that-is-long-enough-to-push-the-path-" \
+                      "past-the-ustar-name-field/pax-long-name.txt"
+#define GNU_LONG_LINK "ext/a-link-target-that-is-long-enough-to-need-its-own-" \
+                      "K-record-before-the-member-it-belongs-to.txt"
+#define PAX_FILE_SIZE 700
+#define LONG_NAME_BLOCKS 17
+
+// The members tar writes once names outgrow the header: a pax global
+// header, a GNU long name, a pax path and size, and a GNU long link
+static void append_long_names(void) {
+    static uint8_t data[PAX_FILE_SIZE];
+    char pax[512];
+    int n;
+
+    n = pax_record(pax, "path", "global-path.txt");
+    n += pax_record(pax + n, "size", "9999");
+    tar_append("pax_global_header", 'g', n, pax, n);
+    memset(data, 'G', 64);
+    tar_append("ext/after-global.txt", '0', 64, data, 64);
+
+    tar_append("././@LongLink", 'L', sizeof(GNU_LONG_NAME), GNU_LONG_NAME, sizeof(GNU_LONG_NAME));
+    memset(data, 'L', 64);
+    tar_append(GNU_LONG_NAME, '0', 64, data, 64);
+
+    // The octal size field is wrong on purpose; the pax size must win
+    n = pax_record(pax, "mtime", "1700000000.5");
+    n += pax_record(pax + n, "path", PAX_LONG_NAME);
+    n += pax_record(pax + n, "size", "700");
+    tar_append("PaxHeaders/short-pax-name.txt", 'x', n, pax, n);
+    memset(data, 'P', PAX_FILE_SIZE);
+    tar_append("ext/short-pax-name.txt", '0', 1, data, PAX_FILE_SIZE);
+
+    tar_append("././@LongLink", 'K', sizeof(GNU_LONG_LINK), GNU_LONG_LINK, sizeof(GNU_LONG_LINK));
+    memset(data, 'K', 64);
+    tar_append("ext/after-longlink.txt", '0', 64, data, 64);
+}
+
+// Synthetic archive: count one-block files spread over 30 directories,
+// then the long name members
+static void build_tar(int count) {
+    tar_size = (uint32_t)count * 1024 + LONG_NAME_BLOCKS * 512 + 1024;
+    tar_image = calloc(1, tar_size);
+    tar_fill = 0;
+    for (int i = 0; i < count; i++) {
+        char name[64];
+        uint8_t data[64];
+        snprintf(name, sizeof(name), "dir%d/file%d.txt", i % 30, i);
+        memset(data, 'a' + i % 26, sizeof(data));
+        tar_append(name, '0', sizeof(data), data, sizeof(data));
+    }
+    append_long_names();
+}
+
+#define LOOKUP_NAMES 16
+static char lookup_names[LOOKUP_NAMES][64];
+
+static void bench_lookup(uint32_t ops) {
+    uint8_t *data;
+    uint32_t size;
+    for (uint32_t i = 0; i < ops; i++) {
+        if (fs_read_file(lookup_names[i % LOOKUP_NAMES], &data, &size)) fs_release_file(data);
+    }
+}
+
+static int run_bench(void) {
+    vga_set_vsync(0);
+    report("vga_fill_rect_100x100", bench_fill_rect, 1000);
+    report("vga_draw_string_38ch", bench_draw_string, 1000);
+    report("vga_flush_full", bench_flush, 1000);
+    report("vga_cursor_move", bench_cursor_move, 1000);
+    report("kalloc_page+kfree_page", bench_page_pair, 10000);
+    report("kalloc_pages(4)+kfree_pages", bench_order4_pair, 10000);
+    report("kmalloc(64)+kfree", bench_kmalloc_pair, 100000);
+
+    build_tar(10000);
+    for (int i = 0; i < LOOKUP_NAMES; i++) {
+        int n = i * 613;  // Spread over the archive
+        snprintf(lookup_names[i], sizeof(lookup_names[i]), "dir%d/file%d.txt", n % 30, n);
+    }
+    quiet = 1;
+    report("parse_tar_10000_files", bench_parse, 1);
+    report("fs_read_file_hit", bench_lookup, 100000);
+    quiet = 0;
+    free(tar_image);
+    return 0;
+}
+
+/* ------------------------------
+   Archive check
+   ------------------------------
+*/
+
+static uint8_t *build_ocz(uint32_t block_size, uint32_t *size, uint32_t *header_size);
+
+// Every entry must be reachable by its own name
+static int check_archive(const char *what, uint8_t *image, uint32_t image_size) {
+    uint64_t start = rdtsc();
+    fs_set_initrd(image, image_size);
+    fs_wait_ready();
+    uint64_t cycles = rdtsc() - start;
+
+    int count = fs_get_file_count();
+    int bad = 0;
+    for (int i = 0; i < count; i++) {
+        char name[128];
+        uint32_t size;
+        int is_dir;
+        uint8_t *a, *b;
+        uint32_t sa, sb;
+        if (!fs_get_file_info(i, name, &size, &is_dir)) continue;
+        int ok_a = fs_read_file_by_index(i, &a, &sa);
+        int ok_b = fs_read_file(name, &b, &sb);
+        if (!ok_a || !ok_b || a != b || sa != sb || sa != size) {
+            fprintf(stderr, "%s: lookup mismatch: %s\n", what, name);
+            bad++;
+        }
+        if (ok_a) fs_release_file(a);
+        if (ok_b) fs_release_file(b);
+    }
+    printf("%s: %d entries, %u bytes, parsed in %llu cycles, %d bad lookups\n",
+           what, count, image_size, (unsigned long long)cycles, bad);
+    return bad;
+}
+
+// The members append_long_names() wrote must come back under their long
+// names with their pax size, and the names they replaced must not
+static int check_long_names(const char *what) {
+    static const struct {
+        const char *name;
+        uint32_t size;
+        uint8_t fill;
+    } present[] = {
+        { "ext/after-global.txt", 64, 'G' },
+        { GNU_LONG_NAME, 64, 'L' },
+        { PAX_LONG_NAME, PAX_FILE_SIZE, 'P' },
+        { "ext/after-longlink.txt", 64, 'K' },
+    };
+    char cut[100];  // What the member's own header holds
+    memcpy(cut, GNU_LONG_NAME, sizeof(cut) - 1);
+    cut[sizeof(cut) - 1] = 0;
+    const char *absent[] = { "pax_global_header", "global-path.txt", cut,
+                             "ext/short-pax-name.txt", "././@LongLink" };
+
+    int bad = 0;
+    for (size_t i = 0; i < sizeof(present) / sizeof(present[0]); i++) {
+        uint8_t *data;
+        uint32_t size;
+        if (!fs_read_file(present[i].name, &data, &size)) {
+            fprintf(stderr, "%s: %s not found\n", what, present[i].name);
+            bad++;
+            continue;
+        }
+        uint32_t at = 0;
+        while (at < size && data[at] == present[i].fill) at++;
+        if (size != present[i].size || at != size) {
+            fprintf(stderr, "%s: %s is %u bytes (want %u), wrong from byte %u\n",
+                    what, present[i].name, size, present[i].size, at);
+            bad++;
+        }
+        fs_release_file(data);
+    }
+    for (size_t i = 0; i < sizeof(absent) / sizeof(absent[0]); i++) {
+        uint8_t *data;
+        uint32_t size;
+        if (fs_read_file(absent[i], &data, &size)) {
+            fprintf(stderr, "%s: %s should not be indexed\n", what, absent[i]);
+            fs_release_file(data);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static int run_tar(const char *path) {
+    if (!path) {
+        // The synthetic archive, plain and packed as OCZ1 in blocks small
+        // enough that the long name members straddle them
+        build_tar(300);
+        int bad = check_archive("plain", tar_image, tar_size) + check_long_names("plain");
+        uint32_t size, header_size;
+        uint8_t *image = build_ocz(1024, &size, &header_size);
+        bad += check_archive("ocz1", image, size) + check_long_names("ocz1");
+        fs_set_initrd(NULL, 0);
+        free(image);
+        free(tar_image);
+        return bad != 0;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len <= 0 || len > 0xFFFFFFFFL) {
+        fprintf(stderr, "%s: unsupported size\n", path);
+        fclose(f);
+        return 1;
+    }
+    tar_size = (uint32_t)len;
+    tar_image = malloc(tar_size);
+    if (fread(tar_image, 1, tar_size, f) != tar_size) {
+        perror(path);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    int bad = check_archive(path, tar_image, tar_size);
+    fs_set_initrd(NULL, 0);
+    free(tar_image);
+    return bad != 0;
+}
+
+/* ------------------------------
+   Fuzzing
+   ------------------------------
+*/
+
+#define FUZZ_SLOTS 512
+
+struct fuzz_block {
+    uint8_t *addr;
+    size_t size;
+    int order;      // -1 for kmalloc
+    uint8_t fill;
+};
+
+static int check_block(const struct fuzz_block *b) {
+    for (size_t i = 0; i < b->size; i++) {
+        if (b->addr[i] != b->fill) {
+            fprintf(stderr, "fuzz: block %p (order %d, size %zu) corrupted at %zu\n",
+                    (void *)b->addr, b->order, b->size, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int fuzz_allocators(uint32_t rounds) {
+    static struct fuzz_block slots[FUZZ_SLOTS];
+    for (uint32_t r = 0; r < rounds; r++) {
+        struct fuzz_block *b = &slots[rand() % FUZZ_SLOTS];
+        if (b->addr) {
+            if (!check_block(b)) return 1;
+            if (b->order >= 0) {
+                kfree_pages(b->addr, b->order);
+                b->addr = NULL;
+            } else if (rand() % 2) {
+                kfree(b->addr);
+                b->addr = NULL;
+            } else {
+                size_t size = rand() % 6000 + 1;
+                uint8_t *p = krealloc(b->addr, size);
+                if (!p) continue;
+                if (size > b->size) memset(p + b->size, b->fill, size - b->size);
+                b->addr = p;
+                b->size = size;
+                if (!check_block(b)) return 1;
+            }
+        } else {
+            b->fill = (uint8_t)rand();
+            if (rand() % 2) {
+                b->order = rand() % 5;
+                b->size = (size_t)PAGE_SIZE << b->order;
+                b->addr = kalloc_pages(b->order);
+                if (b->addr && ((uintptr_t)b->addr & (b->size - 1))) {
+                    fprintf(stderr, "fuzz: order %d block %p misaligned\n", b->order, (void *)b->addr);
+                    return 1;
+                }
+            } else {
+                b->order = -1;
+                b->size = rand() % 3000 + 1;
+                b->addr = kmalloc(b->size);
+            }
+            if (b->addr) memset(b->addr, b->fill, b->size);
+        }
+        if (r % 64 == 0) p_memory_component->tick();  // Zero pool refill
+    }
+
+    for (int i = 0; i < FUZZ_SLOTS; i++) {
+        struct fuzz_block *b = &slots[i];
+        if (!b->addr) continue;
+        if (!check_block(b)) return 1;
+        if (b->order >= 0) kfree_pages(b->addr, b->order);
+        else kfree(b->addr);
+        b->addr = NULL;
+    }
+    return 0;
+}
+
+// Parse randomly damaged archives; a crash or a hang is the failure
+static void fuzz_tar(uint32_t rounds) {
+    build_tar(200);
+    uint8_t *pristine = malloc(tar_size);
+    memcpy(pristine, tar_image, tar_size);
+
+    quiet = 1;
+    for (uint32_t r = 0; r < rounds; r++) {
+        memcpy(tar_image, pristine, tar_size);
+        int flips = rand() % 32 + 1;
+        for (int i = 0; i < flips; i++) tar_image[rand() % tar_size] = (uint8_t)rand();
+        uint32_t size = rand() % 4 ? tar_size : (uint32_t)(rand() % tar_size);
+        fs_set_initrd(tar_image, size);
+
+        // A miss parses on demand; then index the rest and walk it all
+        uint8_t *data;
+        uint32_t fsize;
+        if (fs_read_file("dir1/file1.txt", &data, &fsize)) fs_release_file(data);
+        fs_wait_ready();
+        int count = fs_get_file_count();
+        for (int i = 0; i < count; i++) {
+            if (fs_read_file_by_index(i, &data, &fsize)) fs_release_file(data);
+        }
+    }
+    quiet = 0;
+    fs_set_initrd(NULL, 0);
+    free(pristine);
+    free(tar_image);
+}
+
+/* OCZ1 containers (see tarfs.c) built from tar_image, so the LZ4
+   decoder and the container parser see hostile input too. The encoder
+   is a C copy of the greedy one in tools/mkinitrdz.py. */
+
+#define LZ4_HASH_BITS 12
+
+static uint8_t *put_length(uint8_t *op, uint32_t n) {
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+static uint8_t *lz4_emit(uint8_t *op, const uint8_t *lit, uint32_t lit_len,
+                         uint32_t match_len, uint32_t offset) {
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) op = put_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        uint32_t m = match_len - 4;
+        *token |= (uint8_t)(m < 15 ? m : 15);
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (m >= 15) op = put_length(op, m - 15);
+    }
+    return op;
+}
+
+// dst needs n + n / 255 + 16 bytes
+static uint32_t lz4_compress(const uint8_t *src, uint32_t n, uint8_t *dst) {
+    int32_t table[1 << LZ4_HASH_BITS];
+    for (int i = 0; i < (1 << LZ4_HASH_BITS); i++) table[i] = -1;
+
+    uint8_t *op = dst;
+    uint32_t anchor = 0, i = 0;
+    while (n > 12 && i < n - 12) {  // The last 12 bytes never start a match
+        uint32_t v;
+        memcpy(&v, src + i, 4);
+        uint32_t h = (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+        int32_t cand = table[h];
+        table[h] = (int32_t)i;
+        if (cand < 0 || i - cand > 65535 || memcmp(src + cand, src + i, 4) != 0) {
+            i++;
+            continue;
+        }
+        uint32_t len = 4;
+        while (i + len < n - 5 && src[cand + len] == src[i + len]) len++;
+        op = lz4_emit(op, src + anchor, i - anchor, len, i - cand);
+        i += len;
+        anchor = i;
+    }
+    op = lz4_emit(op, src + anchor, n - anchor, 0, 0);
+    return (uint32_t)(op - dst);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Pack tar_image into a new OCZ1 image; *header_size covers the offset table
+static uint8_t *build_ocz(uint32_t block_size, uint32_t *size, uint32_t *header_size) {
+    uint32_t count = (tar_size + block_size - 1) / block_size;
+    *header_size = 16 + 4 * (count + 1);
+    uint8_t *out = malloc(*header_size + tar_size + count * (block_size / 255 + 16));
+    memcpy(out, "OCZ1", 4);
+    put_le32(out + 4, block_size);
+    put_le32(out + 8, tar_size);
+    put_le32(out + 12, count);
+
+    uint32_t pos = *header_size;
+    for (uint32_t b = 0; b < count; b++) {
+        put_le32(out + 16 + 4 * b, pos);
+        uint32_t raw = tar_size - b * block_size < block_size ? tar_size - b * block_size : block_size;
+        uint32_t packed = lz4_compress(tar_image + b * block_size, raw, out + pos);
+        if (packed >= raw) {
+            memcpy(out + pos, tar_image + b * block_size, raw);  // Stored
+            packed = raw;
+        }
+        pos += packed;
+    }
+    put_le32(out + 16 + 4 * count, pos);
+    *size = pos;
+    return out;
+}
+
+static void fuzz_ocz(uint32_t rounds) {
+    static const uint32_t block_sizes[] = { 1024, 4096, 65536 };
+    build_tar(200);
+
+    quiet = 1;
+    for (uint32_t r = 0; r < rounds; r++) {
+        uint32_t size, header_size;
+        uint8_t *image = build_ocz(block_sizes[rand() % 3], &size, &header_size);
+
+        // Half the flips land in the header and offset table, where a
+        // single bad value has the most reach
+        int flips = rand() % 16 + 1;
+        for (int i = 0; i < flips; i++) {
+            uint32_t at = rand() % 2 ? rand() % header_size : rand() % size;
+            image[at] = (uint8_t)rand();
+        }
+        if (rand() % 4 == 0) size = rand() % size;
+        fs_set_initrd(image, size);
+
+        uint8_t *data;
+        uint32_t fsize;
+        if (fs_read_file("dir1/file1.txt", &data, &fsize)) fs_release_file(data);
+        fs_wait_ready();
+        int count = fs_get_file_count();
+        for (int i = 0; i < count; i++) {
+            if (fs_read_file_by_index(i, &data, &fsize)) fs_release_file(data);
+        }
+        fs_set_initrd(NULL, 0);  // Drop the index before image goes away
+        free(image);
+    }
+    quiet = 0;
+    free(tar_image);
+}
+
+static int run_fuzz(uint32_t rounds, unsigned seed) {
+    srand(seed);
+
+    // A short warm-up first: the slab caches are created lazily and each
+    // keeps one empty spare slab, so the baseline is only meaningful once
+    // every size class has been touched. After that every page must come
+    // back.
+    if (fuzz_allocators(2000)) return 1;
+    fuzz_tar(1);
+    fuzz_ocz(1);
+    uint64_t free_before = get_free_pages();
+
+    if (fuzz_allocators(rounds)) return 1;
+    fuzz_tar(rounds / 100 + 1);
+    fuzz_ocz(rounds / 100 + 1);
+    uint64_t free_after = get_free_pages();
+    printf("fuzz: %u rounds, seed %u, %llu pages free before, %llu after\n",
+           rounds, seed, (unsigned long long)free_before,
+           (unsigned long long)free_after);
+    if (free_after != free_before) {
+        fprintf(stderr, "fuzz: %lld pages leaked\n",
+                (long long)(free_before - free_after));
+        return 1;
+    }
+    return 0;
+}
+
+/* ------------------------------
+   SPSC rings
+   ------------------------------
+*/
+
+#define RING_FAIL(...) do { fprintf(stderr, "ring: " __VA_ARGS__); fputc('\n', stderr); return 1; } while (0)
+
+SPSC_RING(small_ring, uint32_t, 8);
+SPSC_RING(race_ring, uint32_t, 64);
+
+#define RACE_ITEMS 2000000u
+
+// Exact cases: batches that only partly fit, drops and their position,
+// and indices that wrap past UINT32_MAX
+static int check_ring_cases(void) {
+    static struct small_ring r;
+    uint32_t in[16], out[16];
+    for (uint32_t i = 0; i < 16; i++) in[i] = 100 + i;
+
+    r.head = r.tail = 0xFFFFFFFCu;  // Four pushes from wrapping
+    if (small_ring_push_n(&r, in, 5) != 5 || small_ring_count(&r) != 5)
+        RING_FAIL("push_n into an empty ring");
+    if (small_ring_push_n(&r, in + 5, 6) != 3) RING_FAIL("push_n past full should take 3");
+    if (small_ring_dropped(&r) != 3) RING_FAIL("dropped %u, want 3", small_ring_dropped(&r));
+    if (small_ring_drop_at(&r) != 0x00000004u)
+        RING_FAIL("drop_at %08x, want 00000004", small_ring_drop_at(&r));
+    if (small_ring_push(&r, 999)) RING_FAIL("push into a full ring succeeded");
+    if (small_ring_dropped(&r) != 4) RING_FAIL("a refused push must count as dropped");
+
+    if (small_ring_pop_n(&r, out, 3) != 3) RING_FAIL("pop_n of 3");
+    if (small_ring_tail(&r) != 0xFFFFFFFFu) RING_FAIL("tail after 3 pops");
+    if (small_ring_pop_n(&r, out + 3, 16) != 5) RING_FAIL("pop_n should stop at what is there");
+    for (uint32_t i = 0; i < 8; i++) {
+        if (out[i] != 100 + i) RING_FAIL("item %u is %u, want %u", i, out[i], 100 + i);
+    }
+    if (small_ring_pop(&r, out) || small_ring_count(&r) != 0) RING_FAIL("ring should be empty");
+
+    // Random batches against a model, many times around the array
+    uint32_t next_in = 0, next_out = 0, model_dropped = small_ring_dropped(&r);
+    for (int step = 0; step < 1000000; step++) {
+        uint32_t n = rand() % 11;
+        if (rand() % 2) {
+            for (uint32_t i = 0; i < n; i++) in[i] = next_in + i;
+            uint32_t space = 8 - (next_in - next_out);
+            uint32_t want = n < space ? n : space;
+            if (small_ring_push_n(&r, in, n) != want) RING_FAIL("step %d: push_n took the wrong count", step);
+            next_in += want;
+            model_dropped += n - want;
+            if (small_ring_dropped(&r) != model_dropped) RING_FAIL("step %d: drop count", step);
+        } else {
+            uint32_t have = next_in - next_out;
+            uint32_t got = small_ring_pop_n(&r, out, n);
+            if (got != (n < have ? n : have)) RING_FAIL("step %d: pop_n returned %u", step, got);
+            for (uint32_t i = 0; i < got; i++) {
+                if (out[i] != next_out++) RING_FAIL("step %d: out of order", step);
+            }
+        }
+        if (small_ring_count(&r) != next_in - next_out) RING_FAIL("step %d: count", step);
+    }
+    return 0;
+}
+
+static struct race_ring race;
+
+// Producer thread: every value in order, retrying the ones refused
+static void *race_producer(void *arg) {
+    (void)arg;
+    uint32_t batch[7];
+    uint32_t next = 0;
+    while (next < RACE_ITEMS) {
+        uint32_t n = (uint32_t)(next % 7) + 1;
+        if (n > RACE_ITEMS - next) n = RACE_ITEMS - next;
+        for (uint32_t i = 0; i < n; i++) batch[i] = next + i;
+        uint32_t pushed = race_ring_push_n(&race, batch, n);
+        if (pushed < n) sched_yield();  // Full: let the consumer run on one CPU
+        next += pushed;
+    }
+    return NULL;
+}
+
+// Two threads hammering one ring; nothing may be lost, duplicated or reordered
+static int check_ring_race(void) {
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, race_producer, NULL) != 0) RING_FAIL("pthread_create");
+
+    uint32_t batch[13];
+    uint32_t expect = 0;
+    int bad = 0;
+    while (expect < RACE_ITEMS && !bad) {
+        uint32_t n = race_ring_pop_n(&race, batch, 13);
+        if (n == 0) sched_yield();
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i] != expect++) bad = 1;
+        }
+    }
+    pthread_join(producer, NULL);
+    if (bad) RING_FAIL("consumer saw %u out of order", expect - 1);
+    if (race_ring_count(&race) != 0) RING_FAIL("items left over");
+    printf("ring: %u items across two threads, %u refused pushes retried\n",
+           RACE_ITEMS, race_ring_dropped(&race));
+    return 0;
+}
+
+static int run_ring(void) {
+    srand(1);
+    if (check_ring_cases() || check_ring_race()) return 1;
+    printf("ring: all checks passed\n");
+    return 0;
+}
+
+static int usage(void) {
+    fprintf(stderr,
+            "usage: opencomp-host [-m MB] [-f WxH] bench\n"
+            "       opencomp-host [-m MB] tar [FILE]\n"
+            "       opencomp-host [-m MB] fuzz [ROUNDS] [SEED]\n"
+            "       opencomp-host ring\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    size_t memory_mb = DEFAULT_MEMORY_MB;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-m") == 0) {
+            memory_mb = strtoul(argv[arg + 1], NULL, 0);
+        } else if (strcmp(argv[arg], "-f") == 0) {
+            unsigned width, height;
+            if (sscanf(argv[arg + 1], "%ux%u", &width, &height) != 2 || !width || !height)
+                return usage();
+            fake_framebuffer(width, height);
+        } else {
+            return usage();
+        }
+        arg += 2;
+    }
+    if (arg >= argc || memory_mb == 0) return usage();
+
+    const char *cmd = argv[arg++];
+    if (strcmp(cmd, "bench") == 0) {
+        boot(memory_mb);
+        return run_bench();
+    }
+    if (strcmp(cmd, "tar") == 0) {
+        boot(memory_mb);
+        return run_tar(arg < argc ? argv[arg] : NULL);
+    }
+    if (strcmp(cmd, "ring") == 0) return run_ring();
+    if (strcmp(cmd, "fuzz") == 0) {
+        uint32_t rounds = arg < argc ? strtoul(argv[arg], NULL, 0) : 100000;
+        unsigned seed = arg + 1 < argc ? strtoul(argv[arg + 1], NULL, 0) : 1;
+        boot(memory_mb);
+        return run_fuzz(rounds, seed);
+    }
+    return usage();
+}
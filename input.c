@@ -0,0 +1,32 @@
+/* input.c
+ *
+ * Unified input event stream for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * The keyboard and mouse drivers turn their raw bytes into struct
+ * input_event records and post them here from their ticks; the desktop
+ * reads them back in batches once per frame, in the order they
+ * happened. All posting happens in the main loop, one tick at a time,
+ * so the drivers together are the ring's single producer.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+SPSC_RING(input_ring, struct input_event, 128);
+static struct input_ring events;
+
+void input_post(struct input_event *ev) {
+    ev->time_ms = (uint32_t)timer_get_ms();
+    input_ring_push(&events, *ev);
+    kernel_raise_event(EVENT_INPUT);
+}
+
+int input_read(struct input_event *out, int max) {
+    return input_ring_pop_n(&events, out, max);
+}
+
+uint32_t input_dropped(void) {
+    return input_ring_dropped(&events);
+}
@@ -0,0 +1,186 @@
+/* interrupts.c
+ *
+ * IDT setup, 8259 PIC remapping and IRQ dispatch for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * CPU exceptions occupy vectors 0-31; the master/slave PICs are
+ * remapped to vectors 32-47 so IRQs don't collide with exceptions.
+ * Drivers register a handler with irq_install_handler(), which also
+ * unmasks the line. All other lines stay masked. Vectors 48-63 come
+ * from the local APIC instead: 48 is the SMP wakeup IPI, acked at the
+ * APIC, and 63 its spurious vector, which must not be acked at all.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define IDT_ENTRIES 64
+#define IRQ_BASE_VECTOR 32
+#define KERNEL_CODE_SELECTOR 0x08
+
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA 0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_descriptor_t;
+
+static idt_entry_t idt[IDT_ENTRIES];
+static idt_descriptor_t idtr;
+static irq_handler_t irq_handlers[16];
+static uint16_t irq_mask = 0xFFFB;  // Everything masked except the cascade (IRQ2)
+
+extern uint32_t isr_stub_table[IDT_ENTRIES];
+
+static const char *exception_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow",
+    "Bound range", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor overrun", "Invalid TSS",
+    "Segment not present", "Stack fault", "General protection",
+    "Page fault", "Reserved", "x87 FPU error", "Alignment check",
+    "Machine check", "SIMD exception", "Virtualization", "Control protection",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
+    "Reserved", "Hypervisor injection", "VMM communication",
+    "Security exception", "Reserved"
+};
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+static void idt_set_gate(int vector, uint32_t handler) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SELECTOR;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = 0x8E;  // Present, ring 0, 32-bit interrupt gate
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, irq_mask & 0xFF);
+    outb(PIC2_DATA, (irq_mask >> 8) & 0xFF);
+}
+
+// Remap the PICs to vectors 32-47
+static void pic_remap(void) {
+    outb(PIC1_COMMAND, 0x11); io_wait();  // ICW1: init + ICW4 follows
+    outb(PIC2_COMMAND, 0x11); io_wait();
+    outb(PIC1_DATA, IRQ_BASE_VECTOR); io_wait();      // ICW2: vector offsets
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8); io_wait();
+    outb(PIC1_DATA, 0x04); io_wait();     // ICW3: slave on IRQ2
+    outb(PIC2_DATA, 0x02); io_wait();
+    outb(PIC1_DATA, 0x01); io_wait();     // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01); io_wait();
+    pic_write_mask();
+}
+
+// Spurious IRQ7/IRQ15 show up without the matching in-service bit
+static int pic_is_spurious(int irq) {
+    if (irq == 7) {
+        outb(PIC1_COMMAND, PIC_READ_ISR);
+        return (inb(PIC1_COMMAND) & 0x80) == 0;
+    }
+    if (irq == 15) {
+        outb(PIC2_COMMAND, PIC_READ_ISR);
+        if ((inb(PIC2_COMMAND) & 0x80) == 0) {
+            outb(PIC1_COMMAND, PIC_EOI);  // Master still saw the cascade
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pic_send_eoi(int irq) {
+    if (irq >= 8) outb(PIC2_COMMAND, PIC_EOI);
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+void irq_install_handler(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq >= 16) return;
+    irq_handlers[irq] = handler;
+    irq_mask &= ~(1 << irq);
+    pic_write_mask();
+}
+
+// Mask or unmask one PIC line, leaving the rest alone
+int irq_set_masked(int irq, int masked) {
+    if (irq < 0 || irq >= 16) return 1;
+    int was = (irq_mask >> irq) & 1;
+    if (masked) irq_mask |= 1 << irq;
+    else irq_mask &= ~(1 << irq);
+    pic_write_mask();
+    return was;
+}
+
+// Called from isr_common in isr.S
+void interrupt_dispatch(struct interrupt_frame *frame) {
+    uint32_t vector = frame->vector;
+
+    if (vector < IRQ_BASE_VECTOR) {
+        char buf[32];
+        puts("\n[interrupts] EXCEPTION: ");
+        puts(exception_names[vector]);
+        puts(" at EIP ");
+        itoa_u(frame->eip, buf);
+        puts(buf);
+        puts(", error ");
+        itoa_u(frame->error_code, buf);
+        puts(buf);
+        puts("\n[interrupts] System halted.\n");
+        for (;;) __asm__ volatile("cli; hlt");
+    }
+
+    if (vector >= IPI_WAKE_VECTOR) {
+        if (vector == IPI_WAKE_VECTOR) smp_ipi_handler();
+        return;
+    }
+
+    int irq = vector - IRQ_BASE_VECTOR;
+    if (pic_is_spurious(irq)) return;
+    // The 1 kHz timer alone would outrun the serial sink
+    if (irq != 0) trace_event(TRACE_SOURCE_IRQ, TRACE_IRQ, irq);
+    if (irq_handlers[irq]) irq_handlers[irq]();
+    pic_send_eoi(irq);
+}
+
+// Every CPU shares the one IDT
+void interrupts_load(void) {
+    __asm__ volatile("lidt %0" : : "m"(idtr));
+}
+
+void interrupts_init(void) {
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt_set_gate(i, isr_stub_table[i]);
+    }
+
+    idtr.limit = sizeof(idt) - 1;
+    idtr.base = (uint32_t)idt;
+    interrupts_load();
+
+    pic_remap();
+    puts("[interrupts] IDT loaded, PIC remapped to vectors 32-47\n");
+}
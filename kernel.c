@@ -8,7 +8,7 @@
  *  - VGA text output with extended functions
  *  - a "component" API: components provide a name and init/tick functions
  *  - desktop environment support
- *  - keyboard input
+ *  - interrupt-driven keyboard/mouse input (IDT + 8259 PIC)
  *  - memory management
  *
  * Note: This is a minimal 64-bit kernel meant to be loaded by GRUB (multiboot2).
@@ -102,53 +102,260 @@ void str_append(char *dest, const char *src) {
 extern struct component *__start_comps;
 extern struct component *__stop_comps;
 
+#define MAX_COMPONENTS 64
+
+// Init order as indexes into .comps: [0, boot_count) run at boot, the
+// rest from the main loop, deferred_next being the next one due
+static int init_order[MAX_COMPONENTS];
+static int init_count = 0;
+static int boot_count = 0;
+static int deferred_next = 0;
+
+static int str_eq(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static int find_component(struct component **comps, int n, const char *name) {
+    for (int i = 0; i < n; i++) {
+        if (comps[i] && comps[i]->name && str_eq(comps[i]->name, name)) return i;
+    }
+    return -1;
+}
+
+static int deps_placed(struct component **comps, int n, const struct component *c,
+                       const uint8_t *placed) {
+    for (const char *const *d = c->deps; d && *d; d++) {
+        int j = find_component(comps, n, *d);
+        if (j >= 0 && !placed[j]) return 0;
+    }
+    return 1;
+}
+
+// Topological sort of the components by deps, priority, then link order
+static void sort_components(struct component **comps, int n) {
+    uint8_t placed[MAX_COMPONENTS] = { 0 };
+
+    for (int i = 0; i < n; i++) {
+        const struct component *c = comps[i];
+        for (const char *const *d = c && c->name ? c->deps : NULL; d && *d; d++) {
+            if (find_component(comps, n, *d) >= 0) continue;
+            puts("[kernel] ");
+            puts(c->name);
+            puts(" depends on missing component ");
+            puts(*d);
+            puts("\n");
+        }
+    }
+
+    // Pass 0 places everything that can init at boot; pass 1 the
+    // deferred components and whatever depends on them
+    for (int pass = 0; pass < 2; pass++) {
+        for (;;) {
+            int best = -1;
+            for (int i = 0; i < n; i++) {
+                const struct component *c = comps[i];
+                if (!c || !c->name || placed[i]) continue;
+                if (pass == 0 && (c->flags & COMPONENT_DEFERRED)) continue;
+                if (!deps_placed(comps, n, c, placed)) continue;
+                if (best < 0 || c->priority < comps[best]->priority) best = i;
+            }
+            if (best < 0) break;
+            placed[best] = 1;
+            init_order[init_count++] = best;
+        }
+        if (pass == 0) boot_count = init_count;
+    }
+
+    // Anything left waits on a cycle; break it in link order
+    for (int i = 0; i < n; i++) {
+        if (!comps[i] || !comps[i]->name || placed[i]) continue;
+        puts("[kernel] Dependency cycle through ");
+        puts(comps[i]->name);
+        puts("\n");
+        init_order[init_count++] = i;
+    }
+}
+
+static void run_init(int index) {
+    struct component *c = ((struct component **)&__start_comps)[index];
+    puts("Component: ");
+    puts(c->name);
+    puts(" - init\n");
+    if (c->init) {
+        uint16_t id = index;
+        trace_set_source(id);
+        trace_event(id, TRACE_INIT_BEGIN, 0);
+        uint64_t start = rdtsc();
+        c->init();
+        c->stats.init_cycles = rdtsc() - start;
+        trace_event(id, TRACE_INIT_END, 0);
+        trace_set_source(TRACE_SOURCE_KERNEL);
+    }
+    c->ready = 1;
+}
+
 static void register_components_and_init(void) {
-    struct component **it = (struct component **)&__start_comps;
-    struct component **end = (struct component **)&__stop_comps;
-    if (it == end) {
+    struct component **comps = (struct component **)&__start_comps;
+    int n = (struct component **)&__stop_comps - comps;
+    if (n == 0) {
         puts("No components found.\n");
         return;
     }
-    while (it < end) {
-        struct component *c = *it;
-        if (c && c->name) {
-            puts("Component: ");
-            puts(c->name);
-            puts(" - init\n");
-            if (c->init) c->init();
-        }
-        ++it;
+    if (n > MAX_COMPONENTS) {
+        puts("[kernel] Too many components, ignoring the rest\n");
+        n = MAX_COMPONENTS;
     }
+
+    sort_components(comps, n);
+    for (int i = 0; i < boot_count; i++) run_init(init_order[i]);
+    deferred_next = boot_count;
+}
+
+// One deferred init per main loop pass, so input and redraws get a turn
+static void run_deferred_init(void) {
+    run_init(init_order[deferred_next++]);
+    if (deferred_next == init_count) trace_event(TRACE_SOURCE_KERNEL, TRACE_BOOT, 3);
 }
 
-/* Kernel main loop: call tick() on each component in round-robin */
+/* Events raised by IRQ handlers and components, consumed by the main loop */
+static volatile uint32_t pending_events = 0;
+
+void kernel_raise_event(uint32_t events) {
+    __atomic_or_fetch(&pending_events, events, __ATOMIC_SEQ_CST);
+}
+
+int kernel_component_count(void) {
+    return (struct component **)&__stop_comps - (struct component **)&__start_comps;
+}
+
+const struct component *kernel_get_component(int index) {
+    if (index < 0 || index >= kernel_component_count()) return NULL;
+    return ((struct component **)&__start_comps)[index];
+}
+
+// Set while a component's tick() runs, for kernel_wake_at()
+static struct component *running = NULL;
+
+void kernel_wake_at(uint64_t ms) {
+    if (!running) return;
+    if (running->wake_ms == 0 || ms < running->wake_ms) running->wake_ms = ms;
+}
+
+static void component_run_tick(struct component *c, uint16_t id) {
+    trace_set_source(id);
+    trace_event(id, TRACE_TICK_BEGIN, 0);
+    uint64_t start = rdtsc();
+    running = c;
+    c->tick();
+    running = NULL;
+    uint64_t cycles = rdtsc() - start;
+    trace_event(id, TRACE_TICK_END, 0);
+    trace_set_source(TRACE_SOURCE_KERNEL);
+
+    struct component_stats *st = &c->stats;
+    if (st->tick_calls == 0 || cycles < st->tick_min) st->tick_min = cycles;
+    if (cycles > st->tick_max) st->tick_max = cycles;
+    st->tick_cycles += cycles;
+    st->tick_calls++;
+}
+
+static int component_is_due(struct component *c, uint32_t events, uint64_t now) {
+    if (c->wake_events & events) return 1;
+    if (c->wake_ms && now >= c->wake_ms) return 1;
+    if (c->period_ms) return now >= c->next_run_ms;
+    return c->wake_events == 0;
+}
+
+/* Kernel main loop: tick only the components that have work, hlt otherwise */
 static void kernel_main_loop(void) {
     struct component **it = (struct component **)&__start_comps;
     struct component **end = (struct component **)&__stop_comps;
+
+    uint64_t now = timer_get_ms();
+    for (struct component **p = it; p < end; ++p) {
+        struct component *c = *p;
+        if (c && c->period_ms) c->next_run_ms = now + c->period_ms;
+    }
+
     while (1) {
+        if (deferred_next < init_count) run_deferred_init();
+        now = timer_get_ms();
+
+        // Earliest periodic or one-shot deadline across all components
+        uint64_t deadline = UINT64_MAX;
+        for (struct component **p = it; p < end; ++p) {
+            struct component *c = *p;
+            if (!c || !c->tick) continue;
+            if (c->period_ms && c->next_run_ms < deadline) deadline = c->next_run_ms;
+            if (c->wake_ms && c->wake_ms < deadline) deadline = c->wake_ms;
+        }
+
+        // Deferred inits still to run count as work
+        int idle = pending_events == 0 && now < deadline && deferred_next == init_count;
+
+        // Idle time goes to shipping trace records out over COM1
+        if (idle) trace_drain();
+
+        // Sleep until an IRQ raises an event or the deadline passes.
+        // sti;hlt is atomic, so an IRQ between the check and hlt still wakes us.
+        interrupts_disable();
+        if (idle && pending_events == 0) {
+            timer_set_deadline(deadline);
+            __asm__ volatile("sti; hlt" : : : "memory");
+            continue;
+        }
+        uint32_t events = pending_events;
+        pending_events = 0;
+        interrupts_enable();
+
         for (struct component **p = it; p < end; ++p) {
             struct component *c = *p;
-            if (c && c->tick) c->tick();
+            if (!c || !c->ready || !c->tick || !component_is_due(c, events, now)) continue;
+            if (c->wake_ms && now >= c->wake_ms) c->wake_ms = 0;  // tick() may ask again
+            component_run_tick(c, p - it);
+            if (c->period_ms && now >= c->next_run_ms) {
+                // Keep a fixed cadence; skip periods we already missed
+                c->next_run_ms += c->period_ms;
+                if (c->next_run_ms <= now) c->next_run_ms = now + c->period_ms;
+            }
         }
-        // simple busy-wait delay
-        for (volatile uint64_t i=0;i<1000000ULL;i++);
     }
 }
 
-/* Entry point called from assembly stub */
-void kernel_main(void) {
+/* Entry point called from assembly stub with GRUB's EAX/EBX */
+void kernel_main(uint32_t magic, uintptr_t multiboot_info) {
     // basic welcome
     vga_clear(0x0F);
     puts("OpenComp Kernel - Component-Based OS (GPLv2)\n");
     puts("============================================\n\n");
     
+    // Serial first so the trace sink works for everything after it
+    serial_init();
+    trace_event(TRACE_SOURCE_KERNEL, TRACE_BOOT, 0);
+    
+    // Copy out boot modules before the allocator can reuse that memory
+    multiboot_init(magic, multiboot_info);
+
+    // Memory types come from the memory map and framebuffer tag
+    paging_init();
+    
+    // IDT/PIC first so drivers can install IRQ handlers from init()
+    interrupts_init();
+    trace_event(TRACE_SOURCE_KERNEL, TRACE_BOOT, 1);
+
     // init components
     register_components_and_init();
+    interrupts_enable();
+    trace_event(TRACE_SOURCE_KERNEL, TRACE_BOOT, 2);
+
+    // Needs the timer running to pace INIT/SIPI
+    smp_init();
     puts("\nEntering main loop...\n");
     
-    // Small delay to show init messages
-    for (volatile uint64_t i=0;i<50000000ULL;i++);
-    
     kernel_main_loop();
     // never returns
 }
@@ -157,4 +364,4 @@ void kernel_main(void) {
    Minimal stubs for required symbols
    ------------------------------
 */
-void _start_crt_stub(void) { kernel_main(); for(;;); }
+void _start_crt_stub(void) { kernel_main(0, 0); for(;;); }
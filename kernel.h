@@ -11,17 +11,296 @@
 #include <stdint.h>
 #include <stddef.h>
 
-/* Component structure */
+/* Component wakeup events (see kernel_raise_event) */
+#define EVENT_TIMER    (1u << 0)  /* A scheduler deadline expired */
+#define EVENT_KEYBOARD (1u << 1)  /* IRQ1 queued scancodes */
+#define EVENT_MOUSE    (1u << 2)  /* IRQ12 queued packet bytes */
+#define EVENT_MEMORY   (1u << 4)  /* Zeroed-page pool wants refilling */
+#define EVENT_TARFS    (1u << 6)  /* Initrd has headers left to index */
+#define EVENT_INPUT    (1u << 7)  /* Input events are queued (input.c) */
+
+/* TSC cycle counts the kernel collects around every init() and tick() */
+struct component_stats {
+    uint64_t init_cycles;
+    uint64_t tick_calls;
+    uint64_t tick_cycles;   /* Sum over all calls */
+    uint64_t tick_min;
+    uint64_t tick_max;
+};
+
+/* Component structure
+ *
+ * tick() runs when one of wake_events has been raised, and additionally
+ * every period_ms milliseconds if period_ms is non-zero. A component that
+ * sets neither is ticked on every scheduler wakeup. A tick can also ask
+ * for a single later tick with kernel_wake_at().
+ *
+ * init() runs after the init() of every component named in deps (a
+ * NULL-terminated list; names that aren't linked in are ignored). Among
+ * components whose dependencies are met, lower priority goes first,
+ * then link order. COMPONENT_DEFERRED components, and anything that
+ * depends on one, are initialized from the main loop once boot is done
+ * instead, one per loop pass; tick() only runs after init() has.
+ */
+#define COMPONENT_DEFERRED (1u << 0)  /* Slow init that needn't hold up boot */
+
 struct component {
     const char *name;
     void (*init)(void);
     void (*tick)(void);
+    uint32_t wake_events;
+    uint32_t period_ms;
+    const char *const *deps;
+    int priority;
+    uint32_t flags;         /* COMPONENT_* */
+    int ready;              /* Kernel-private: init() has run */
+    uint64_t next_run_ms;   /* Kernel-private: next periodic deadline */
+    uint64_t wake_ms;       /* Kernel-private: one-shot kernel_wake_at(), 0 if none */
+    struct component_stats stats;  /* Kernel-private: profiling counters */
+};
+
+/* Scheduler */
+void kernel_raise_event(uint32_t events);
+void kernel_wake_at(uint64_t ms);   /* From tick(): tick again once ms has passed */
+int kernel_component_count(void);
+const struct component *kernel_get_component(int index);
+
+/* 64-by-32 division; a plain '/' on uint64_t would need libgcc */
+static inline uint64_t div_u64(uint64_t n, uint32_t d) {
+    uint32_t hi = n >> 32, lo = (uint32_t)n;
+    uint32_t q_hi = hi / d, r = hi % d, q_lo;
+    __asm__("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Interrupts */
+struct interrupt_frame {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t vector, error_code;
+    uint32_t eip, cs, eflags;
+};
+
+typedef void (*irq_handler_t)(void);
+
+#define IPI_WAKE_VECTOR 48     /* Inter-processor wakeup, acked at the LAPIC */
+#define APIC_SPURIOUS_VECTOR 63
+
+void interrupts_init(void);
+void interrupts_load(void);     /* Load the shared IDT on an AP */
+void irq_install_handler(int irq, irq_handler_t handler);
+int irq_set_masked(int irq, int masked);  /* Returns whether it was masked */
+
+static inline void interrupts_enable(void) {
+    __asm__ volatile("sti" : : : "memory");
+}
+
+static inline void interrupts_disable(void) {
+    __asm__ volatile("cli" : : : "memory");
+}
+
+/* Disable interrupts, returning the previous EFLAGS for irq_restore() */
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" : : : "memory");
+}
+
+/* Spinlocks. Only for data shared between CPUs; they do not mask IRQs,
+ * so never take one that an IRQ handler on the same CPU might also want. */
+typedef volatile uint32_t spinlock_t;
+
+static inline void spin_lock(spinlock_t *lock) {
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (*lock) __asm__ volatile("pause");
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Single-producer single-consumer rings. SPSC_RING(name, type, size)
+ * declares struct name plus inline name_push(), name_push_n(),
+ * name_pop(), name_pop_n(), name_count() and name_dropped(). Exactly one
+ * context may push (an IRQ handler, say) and one may pop, possibly on
+ * another CPU; neither ever waits. Producer and consumer indices sit on
+ * separate cache lines. A push into a full ring is refused and counted
+ * in 'dropped', which only the producer writes; name_drop_at() is the
+ * stream position (a head value) of the latest gap, so a consumer that
+ * cares about framing can resync where it happened. Size must be a
+ * power of two. Zero-initialised storage is an empty ring. */
+#define CACHE_LINE_SIZE 64
+
+#define SPSC_RING(name, type, size)                                             \
+struct name {                                                                   \
+    uint32_t head __attribute__((aligned(CACHE_LINE_SIZE)));  /* Producer */    \
+    uint32_t dropped;                                                           \
+    uint32_t drop_at;       /* head at the latest drop */                       \
+    uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE)));  /* Consumer */    \
+    type items[size] __attribute__((aligned(CACHE_LINE_SIZE)));                 \
+};                                                                              \
+_Static_assert(((size) & ((size) - 1)) == 0, #name " size must be a power of two"); \
+                                                                                \
+/* Queue up to n items, returning how many fit; the rest count as dropped */  \
+static inline uint32_t name##_push_n(struct name *r, const type *v, uint32_t n) { \
+    uint32_t head = r->head;                                                    \
+    uint32_t space = (size) - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)); \
+    if (n > space) {                                                            \
+        __atomic_store_n(&r->drop_at, head + space, __ATOMIC_RELAXED);          \
+        __atomic_store_n(&r->dropped, r->dropped + n - space, __ATOMIC_RELEASE); \
+        n = space;                                                              \
+    }                                                                           \
+    for (uint32_t i = 0; i < n; i++) r->items[(head + i) & ((size) - 1)] = v[i]; \
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);                     \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline int name##_push(struct name *r, type v) {                        \
+    return name##_push_n(r, &v, 1);                                             \
+}                                                                               \
+                                                                                \
+/* Take up to max items, oldest first; returns how many */                    \
+static inline uint32_t name##_pop_n(struct name *r, type *out, uint32_t max) { \
+    uint32_t tail = r->tail;                                                    \
+    uint32_t n = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;            \
+    if (n > max) n = max;                                                       \
+    for (uint32_t i = 0; i < n; i++) out[i] = r->items[(tail + i) & ((size) - 1)]; \
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);                     \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline int name##_pop(struct name *r, type *out) {                      \
+    return name##_pop_n(r, out, 1);                                             \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_count(struct name *r) {                          \
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -                        \
+           __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);                         \
+}                                                                               \
+                                                                                \
+/* Stream position of the next item name_pop() returns; consumer only */    \
+static inline uint32_t name##_tail(struct name *r) {                           \
+    return r->tail;                                                             \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_dropped(struct name *r) {                        \
+    return __atomic_load_n(&r->dropped, __ATOMIC_ACQUIRE);                      \
+}                                                                               \
+                                                                                \
+/* Read after name_dropped(): where the latest of those drops fell */         \
+static inline uint32_t name##_drop_at(struct name *r) {                        \
+    return __atomic_load_n(&r->drop_at, __ATOMIC_RELAXED);                      \
+}
+
+/* SMP (smp.c). Components all tick on the BSP; the APs only run work
+ * handed out by smp_parallel(), which must not touch the allocators or
+ * any other unlocked kernel state. */
+#define SMP_MAX_CPUS 8
+
+typedef void (*smp_work_fn)(void *arg, int part);
+
+void smp_init(void);
+int smp_cpu_count(void);
+int smp_cpu_id(void);
+void smp_parallel(smp_work_fn fn, void *arg, int parts);
+void smp_ipi_handler(void);
+
+/* Paging (paging.c): a single identity map that only sets memory types */
+void paging_init(void);     /* Build the tables and enable paging on the BSP */
+void paging_enable(void);   /* Enable it on the calling AP; no-op if off */
+
+/* Serial port (COM1, polled) */
+void serial_init(void);
+int serial_available(void);
+int serial_try_putc(char c);   /* 0 if the transmit FIFO is full */
+void serial_write(const char *s);
+
+/* Trace ring (trace.c). Sources are component indices for component
+ * code; trace_mark() tags a record with the component currently running. */
+#define TRACE_SOURCE_KERNEL 0xFFFF
+#define TRACE_SOURCE_IRQ    0xFFFE
+
+#define TRACE_INIT_BEGIN 1
+#define TRACE_INIT_END   2
+#define TRACE_TICK_BEGIN 3
+#define TRACE_TICK_END   4
+#define TRACE_IRQ        5      /* arg: IRQ line */
+#define TRACE_BOOT       6      /* arg: boot stage */
+#define TRACE_USER       0x100  /* Component-defined events start here */
+
+void trace_event(uint16_t source, uint16_t event, uint32_t arg);
+void trace_mark(uint16_t event, uint32_t arg);
+void trace_set_source(uint16_t source);
+void trace_drain(void);
+
+/* Timer */
+#define TIMER_HZ 1000
+
+uint64_t timer_get_ms(void);
+void timer_set_deadline(uint64_t ms);
+
+/* Multiboot2 boot information */
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36D76289
+#define MAX_BOOT_MODULES 8
+#define BOOT_MODULE_CMDLINE 64
+
+struct boot_module {
+    uintptr_t start;        /* Physical address of the first byte */
+    uintptr_t end;          /* One past the last byte */
+    const char *cmdline;    /* Text after the path in grub.cfg's module2 line */
+};
+
+#define MAX_MEMORY_REGIONS 32
+#define MEMORY_AVAILABLE 1      /* multiboot2 mmap type for usable RAM */
+
+struct memory_region {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+};
+
+#define FRAMEBUFFER_TYPE_INDEXED 0
+#define FRAMEBUFFER_TYPE_RGB      1
+#define FRAMEBUFFER_TYPE_EGA_TEXT 2
+
+struct boot_framebuffer {
+    uint64_t addr;          /* Physical address of pixel (0, 0) */
+    uint32_t pitch;         /* Bytes per row, may exceed width * bpp / 8 */
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type;           /* FRAMEBUFFER_TYPE_* */
+    uint8_t red_pos, red_size;      /* Channel layout, RGB type only */
+    uint8_t green_pos, green_size;
+    uint8_t blue_pos, blue_size;
 };
 
+void multiboot_init(uint32_t magic, uintptr_t info_addr);
+int multiboot_module_count(void);
+const struct boot_module *multiboot_get_module(int index);
+int multiboot_memory_region_count(void);
+const struct memory_region *multiboot_get_memory_region(int index);
+const struct boot_framebuffer *multiboot_get_framebuffer(void);  /* NULL if none */
+
 /* VGA Text Mode functions */
 void vga_putchar(char c);
 void vga_putchar_at(int x, int y, char c, uint8_t color);
 void vga_clear(uint8_t color);
+#ifdef OPENCOMP_HOSTED
+/* Userspace build (make host): stay clear of libc's puts() */
+#define puts kernel_puts
+#endif
 void puts(const char *s);
 
 /* VGA Graphics Mode functions */
@@ -32,21 +311,87 @@ void vga_draw_rect(int x, int y, int w, int h, uint8_t color);
 void vga_draw_line(int x0, int y0, int x1, int y1, uint8_t color);
 void vga_draw_char(int x, int y, char c, uint8_t color);
 void vga_draw_string(int x, int y, const char *str, uint8_t color);
+void vga_draw_chars(int x, int y, const char *s, int n, uint8_t color);
+void vga_draw_text_block(int x, int y, int w, int h, const char *text, uint8_t color);
+void vga_mark_dirty(int x, int y, int w, int h);
+void vga_flush(void);
+void vga_set_vsync(int enabled);
+int vga_vsync_available(void);  /* vga_flush() waits for retrace */
+uint64_t vga_last_vsync_wait(void);  /* Cycles of that wait in the last flush */
+void vga_set_clip(int x, int y, int w, int h);
+void vga_reset_clip(void);
+int vga_get_width(void);
+int vga_get_height(void);
+int vga_get_depth(void);   /* Bits per pixel of the active backend */
+void vga_cursor_show(int visible);
+void vga_cursor_move(int x, int y);
 
 /* Utility functions */
 void itoa_u(uint64_t v, char *buf);
 void str_append(char *dest, const char *src);
 
 /* Memory management */
+#define PAGE_SIZE 4096
+
 void *kalloc_page(void);
+void *kalloc_page_nozero(void);
 void kfree_page(void *addr);
+#define MAX_ORDER 10    /* Largest buddy block: 2^10 pages (4 MB) */
+void *kalloc_pages(int order);
+void kfree_pages(void *addr, int order);
 uint64_t get_free_pages(void);
+uint64_t get_total_pages(void);
+
+/* Slab caches for small fixed-size objects (slab.c) */
+struct kmem_cache;
+struct kmem_cache *kmem_cache_create(const char *name, size_t size);
+void *kmem_cache_alloc(struct kmem_cache *cache);  /* Zeroed, NULL when out of memory */
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/* General-purpose heap over the slab caches; memory comes back zeroed */
+void *kmalloc(size_t size);
+void *krealloc(void *ptr, size_t size);
+void kfree(void *ptr);
+
+/* Bump-pointer arena for short-lived scratch memory, not zeroed (arena.c) */
+struct arena_chunk;
+struct arena {
+    struct arena_chunk *head;
+    struct arena_chunk *current;
+};
+void *arena_alloc(struct arena *a, size_t size);
+void arena_reset(struct arena *a);
+
+/* Desktop */
+void gui_desktop_redraw(void);
+
+/* Input event stream (input.c). Drivers post from their ticks, the
+ * desktop drains in batches; posting raises EVENT_INPUT. */
+#define INPUT_KEY_DOWN     1
+#define INPUT_KEY_UP       2
+#define INPUT_MOUSE_MOVE   3
+#define INPUT_MOUSE_BUTTON 4    /* One event per change of the button mask */
+
+#define INPUT_SCANCODE_EXTENDED 0x100  /* Set 1 code had an 0xE0 prefix */
+
+#define MOUSE_BUTTON_LEFT   0x01
+#define MOUSE_BUTTON_RIGHT  0x02
+#define MOUSE_BUTTON_MIDDLE 0x04
+
+struct input_event {
+    uint32_t time_ms;       /* timer_get_ms() when posted */
+    uint8_t type;           /* INPUT_* */
+    uint8_t buttons;        /* Mouse: MOUSE_BUTTON_* held after the event */
+    uint16_t scancode;      /* Key: set 1 make code, maybe | EXTENDED */
+    int16_t x, y;           /* Mouse: pointer position after the event */
+    char ascii;             /* Key down: translated character, or 0 */
+};
 
-/* Keyboard */
-int keyboard_has_key(void);
-char keyboard_get_key(void);
+void input_post(struct input_event *ev);  /* Stamps time_ms */
+int input_read(struct input_event *out, int max);
+uint32_t input_dropped(void);
 
-/* Mouse */
+/* Mouse; keys and motion are only delivered as input events */
 void mouse_get_position(int *x, int *y);
 uint8_t mouse_get_buttons(void);
 
@@ -56,5 +401,10 @@ int fs_get_file_count(void);
 int fs_get_file_info(int index, char *name, uint32_t *size, int *is_dir);
 int fs_read_file(const char *filename, uint8_t **data, uint32_t *size);
 int fs_read_file_by_index(int index, uint8_t **data, uint32_t *size);
+void fs_release_file(const uint8_t *data);  /* Pairs with each successful read */
+int fs_dir_first(const char *path);
+int fs_dir_next(int index);
+int fs_ready(void);         /* Whole initrd indexed? Listings are partial until then */
+void fs_wait_ready(void);
 
 #endif
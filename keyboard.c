@@ -10,11 +10,17 @@
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
+#define KEYBOARD_IRQ 1
 
-#define KEY_BUFFER_SIZE 64
-static uint8_t key_buffer[KEY_BUFFER_SIZE];
-static size_t key_read_pos = 0;
-static size_t key_write_pos = 0;
+// Raw scancodes: pushed by the IRQ1 handler, popped by keyboard_tick
+SPSC_RING(scancode_ring, uint8_t, 128);
+static struct scancode_ring scancodes;
+
+#define SCANCODE_BATCH 32
+#define SCANCODE_PREFIX 0xE0     // Next byte is an extended key
+#define SCANCODE_RELEASE 0x80
+
+static int extended = 0;         // Saw SCANCODE_PREFIX, waiting for the code
 
 static const char scancode_to_ascii[] = {
     0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -30,45 +36,40 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
-static inline void outb(uint16_t port, uint8_t val) {
-    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
-}
-
-int keyboard_has_key(void) {
-    return key_read_pos != key_write_pos;
-}
-
-char keyboard_get_key(void) {
-    if (!keyboard_has_key()) return 0;
-    char c = key_buffer[key_read_pos];
-    key_read_pos = (key_read_pos + 1) % KEY_BUFFER_SIZE;
-    return c;
+// IRQ1: the controller routes keyboard bytes here, so nothing else reads them
+static void keyboard_irq_handler(void) {
+    scancode_ring_push(&scancodes, inb(KEYBOARD_DATA_PORT));
+    kernel_raise_event(EVENT_KEYBOARD);
 }
 
 static void keyboard_init(void) {
-    puts("[keyboard] PS/2 keyboard driver initialized\n");
+    // Discard anything left over from the bootloader
+    while (inb(KEYBOARD_STATUS_PORT) & 0x01) inb(KEYBOARD_DATA_PORT);
+    irq_install_handler(KEYBOARD_IRQ, keyboard_irq_handler);
+    puts("[keyboard] PS/2 keyboard driver initialized (IRQ1)\n");
 }
 
 static void keyboard_tick(void) {
-    // Check if keyboard has data
-    uint8_t status = inb(KEYBOARD_STATUS_PORT);
-    if (status & 0x01) {
-        uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-        
-        // Ignore release codes (bit 7 set)
-        if (scancode & 0x80) return;
-        
-        // Convert to ASCII
-        if (scancode < sizeof(scancode_to_ascii)) {
-            char c = scancode_to_ascii[scancode];
-            if (c != 0) {
-                // Add to buffer
-                size_t next = (key_write_pos + 1) % KEY_BUFFER_SIZE;
-                if (next != key_read_pos) {
-                    key_buffer[key_write_pos] = c;
-                    key_write_pos = next;
-                }
+    uint8_t batch[SCANCODE_BATCH];
+    uint32_t n;
+
+    // Translate every scancode queued since the last tick
+    while ((n = scancode_ring_pop_n(&scancodes, batch, SCANCODE_BATCH)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t scancode = batch[i];
+            if (scancode == SCANCODE_PREFIX) {
+                extended = 1;
+                continue;
             }
+
+            struct input_event ev = { 0 };
+            ev.type = (scancode & SCANCODE_RELEASE) ? INPUT_KEY_UP : INPUT_KEY_DOWN;
+            ev.scancode = scancode & ~SCANCODE_RELEASE;
+            if (extended) ev.scancode |= INPUT_SCANCODE_EXTENDED;
+            else if (ev.type == INPUT_KEY_DOWN && scancode < sizeof(scancode_to_ascii))
+                ev.ascii = scancode_to_ascii[scancode];
+            extended = 0;
+            input_post(&ev);
         }
     }
 }
@@ -76,7 +77,8 @@ static void keyboard_tick(void) {
 __attribute__((section(".compobjs"))) static struct component keyboard_component = {
     .name = "keyboard",
     .init = keyboard_init,
-    .tick = keyboard_tick
+    .tick = keyboard_tick,
+    .wake_events = EVENT_KEYBOARD
 };
 
 __attribute__((section(".comps"))) struct component *p_keyboard_component = &keyboard_component;
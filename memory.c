@@ -4,81 +4,395 @@
  * Copyright (C) 2025 B."Nova" J.
  * Licensed under GNU GPLv2
  *
- * Simple bitmap-based physical memory allocator
+ * Bitmap-based physical memory allocator. Allocation scans the bitmap
+ * a 32-bit word at a time from a next-fit hint, and a small pool of
+ * pre-zeroed pages is refilled in the background so kalloc_page()
+ * usually doesn't have to clear anything.
+ *
+ * Physically contiguous runs come from a buddy allocator layered on the
+ * same bitmap: every free page belongs to exactly one free block of
+ * order 0..MAX_ORDER, and the bitmap stays the single source of truth
+ * for which pages are in use.
+ *
+ * The bitmap and buddy metadata are sized from the multiboot2 memory
+ * map at boot and placed in the first usable RAM above the kernel
+ * image. Page N always describes physical address N * PAGE_SIZE.
  */
 
 #include <stdint.h>
 #include <stddef.h>
 #include "kernel.h"
 
-#define PAGE_SIZE 4096
-#define TOTAL_PAGES 4096  // 16MB of manageable memory
-#define BITMAP_SIZE (TOTAL_PAGES / 8)
+// Without a memory map, assume 16MB of RAM from 2MB like we always did
+#define FALLBACK_BASE 0x200000
+#define FALLBACK_SIZE (16 * 1024 * 1024)
+#define LOW_MEMORY_END 0x100000  // BIOS data, VGA and option ROMs
+#define MAX_PHYS_ADDR 0xFFFFF000u  // Identity map without PAE, so nothing above 4GB is reachable
+
+// Pages zeroed ahead of time by memory_tick(); refilled in small batches
+// whenever kalloc_page() drains the pool below half
+#define ZERO_POOL_SIZE 64
+#define ZERO_POOL_BATCH 4
+
+extern uint8_t __kernel_start[];
+extern uint8_t __kernel_end[];
+
+static uint32_t *page_bitmap;
+static size_t bitmap_words = 0;
+static size_t total_pages = 0;              // Pages covered by the bitmap
+static uint64_t usable_pages = 0;           // Pages the memory map called available
+static uint64_t free_pages = 0;             // Free in the bitmap, excluding the pool
+static size_t next_fit_word = 0;            // Where the next bitmap scan starts
 
-static uint8_t page_bitmap[BITMAP_SIZE];
-static uint64_t free_pages = TOTAL_PAGES;
-static uint64_t base_address = 0x200000; // Start after kernel (2MB)
+static void *zero_pool[ZERO_POOL_SIZE];
+static int zero_pool_count = 0;
+
+// Buddy free lists, linked through per-page metadata (not through the
+// free pages themselves, which kalloc_page_nozero may hand out)
+#define BUDDY_NONE (-1)
+#define BUDDY_NOT_HEAD 0xFF
+
+static int32_t free_list[MAX_ORDER + 1];
+static int32_t *buddy_next;
+static int32_t *buddy_prev;
+static uint8_t *buddy_order;  // Order of the free block starting here
 
 static void set_page_used(size_t page) {
-    page_bitmap[page / 8] |= (1 << (page % 8));
+    page_bitmap[page / 32] |= (1u << (page % 32));
 }
 
 static void set_page_free(size_t page) {
-    page_bitmap[page / 8] &= ~(1 << (page % 8));
+    page_bitmap[page / 32] &= ~(1u << (page % 32));
 }
 
 static int is_page_used(size_t page) {
-    return (page_bitmap[page / 8] & (1 << (page % 8))) != 0;
+    return (page_bitmap[page / 32] & (1u << (page % 32))) != 0;
 }
 
-void *kalloc_page(void) {
-    for (size_t i = 0; i < TOTAL_PAGES; i++) {
-        if (!is_page_used(i)) {
-            set_page_used(i);
+static void zero_pages(void *addr, size_t pages) {
+    uint32_t *p = addr;
+    uint32_t count = pages * (PAGE_SIZE / 4);
+    __asm__ volatile("rep stosl" : "+D"(p), "+c"(count) : "a"(0) : "memory");
+}
+
+static void zero_page(void *addr) {
+    zero_pages(addr, 1);
+}
+
+static void *page_address(size_t page) {
+    return (void *)(page * PAGE_SIZE);
+}
+
+static void buddy_insert(int32_t page, int order) {
+    buddy_order[page] = order;
+    buddy_prev[page] = BUDDY_NONE;
+    buddy_next[page] = free_list[order];
+    if (free_list[order] != BUDDY_NONE) buddy_prev[free_list[order]] = page;
+    free_list[order] = page;
+}
+
+static void buddy_remove(int32_t page) {
+    int order = buddy_order[page];
+    if (buddy_prev[page] != BUDDY_NONE) buddy_next[buddy_prev[page]] = buddy_next[page];
+    else free_list[order] = buddy_next[page];
+    if (buddy_next[page] != BUDDY_NONE) buddy_prev[buddy_next[page]] = buddy_prev[page];
+    buddy_order[page] = BUDDY_NOT_HEAD;
+}
+
+// Return a block to the free lists, merging with its buddy while the
+// buddy is a free block of the same order: O(MAX_ORDER)
+static void buddy_free_block(int32_t page, int order) {
+    while (order < MAX_ORDER) {
+        int32_t buddy = page ^ (1 << order);
+        if ((size_t)buddy >= total_pages || buddy_order[buddy] != order) break;
+        buddy_remove(buddy);
+        if (buddy < page) page = buddy;
+        order++;
+    }
+    buddy_insert(page, order);
+}
+
+// Take a block of exactly 2^order pages, splitting a larger one if needed
+static int32_t buddy_alloc_block(int order) {
+    int k = order;
+    while (k <= MAX_ORDER && free_list[k] == BUDDY_NONE) k++;
+    if (k > MAX_ORDER) return BUDDY_NONE;
+
+    int32_t page = free_list[k];
+    buddy_remove(page);
+    while (k > order) {
+        k--;
+        buddy_insert(page + (1 << k), k);
+    }
+    return page;
+}
+
+// The bitmap scan picked one specific page: cut it out of whatever free
+// block contains it, putting the remaining halves back on the lists
+static void buddy_carve(int32_t page) {
+    int k;
+    int32_t head = page;
+    for (k = 0; k <= MAX_ORDER; k++) {
+        head = page & ~((1 << k) - 1);
+        if (buddy_order[head] == k) break;
+    }
+    if (k > MAX_ORDER) return;  // Not on any list (shouldn't happen)
+
+    buddy_remove(head);
+    while (k > 0) {
+        k--;
+        int32_t half = head + (1 << k);
+        if (page < half) {
+            buddy_insert(half, k);
+        } else {
+            buddy_insert(head, k);
+            head = half;
+        }
+    }
+}
+
+// Take a page from the bitmap: skip full words, then ctz the first hole.
+// The scan resumes where the last one succeeded (next fit), so a mostly
+// full bitmap doesn't make every call walk the used prefix again.
+static void *bitmap_alloc(void) {
+    if (free_pages == 0) return NULL;
+    size_t w = next_fit_word;
+    for (size_t n = 0; n < bitmap_words; n++) {
+        uint32_t word = page_bitmap[w];
+        if (word != 0xFFFFFFFF) {
+            size_t page = w * 32 + __builtin_ctz(~word);
+            page_bitmap[w] = word | (1u << (page % 32));
             free_pages--;
-            void *addr = (void *)(base_address + i * PAGE_SIZE);
-            // Zero the page
-            uint64_t *p = (uint64_t *)addr;
-            for (size_t j = 0; j < PAGE_SIZE / 8; j++) p[j] = 0;
-            return addr;
+            next_fit_word = w;
+            buddy_carve(page);
+            return page_address(page);
         }
+        if (++w == bitmap_words) w = 0;
     }
-    return NULL; // Out of memory
+    return NULL;
+}
+
+static void *zero_pool_pop(void) {
+    if (zero_pool_count == 0) return NULL;
+    void *addr = zero_pool[--zero_pool_count];
+    if (zero_pool_count < ZERO_POOL_SIZE / 2) kernel_raise_event(EVENT_MEMORY);
+    return addr;
+}
+
+// Page with undefined contents, for callers that overwrite it anyway
+void *kalloc_page_nozero(void) {
+    void *addr = bitmap_alloc();
+    if (!addr) addr = zero_pool_pop();  // Last resort, don't fail
+    return addr;
+}
+
+void *kalloc_page(void) {
+    void *addr = zero_pool_pop();
+    if (addr) return addr;
+
+    addr = bitmap_alloc();
+    if (addr) zero_page(addr);
+    return addr; // NULL when out of memory
 }
 
 void kfree_page(void *addr) {
-    uint64_t page = ((uint64_t)addr - base_address) / PAGE_SIZE;
-    if (page < TOTAL_PAGES) {
-        set_page_free(page);
-        free_pages++;
+    kfree_pages(addr, 0);
+}
+
+// 2^order physically contiguous, zeroed pages aligned to their size
+void *kalloc_pages(int order) {
+    if (order < 0 || order > MAX_ORDER) return NULL;
+    if (order == 0) return kalloc_page();
+
+    int32_t page = buddy_alloc_block(order);
+    if (page == BUDDY_NONE) return NULL;
+
+    size_t count = (size_t)1 << order;
+    for (size_t i = 0; i < count; i++) set_page_used(page + i);
+    free_pages -= count;
+
+    void *addr = page_address(page);
+    zero_pages(addr, count);
+    return addr;
+}
+
+void kfree_pages(void *addr, int order) {
+    if (order < 0 || order > MAX_ORDER) return;
+    uintptr_t page = (uintptr_t)addr / PAGE_SIZE;
+    size_t count = (size_t)1 << order;
+    if ((uintptr_t)addr < LOW_MEMORY_END || page + count > total_pages) return;
+    if (page & (count - 1)) return;  // Not a block this order could have returned
+
+    for (size_t i = 0; i < count; i++) {
+        if (!is_page_used(page + i)) return;  // Double free
     }
+    for (size_t i = 0; i < count; i++) set_page_free(page + i);
+    free_pages += count;
+    buddy_free_block(page, order);
 }
 
 uint64_t get_free_pages(void) {
-    return free_pages;
+    return free_pages + zero_pool_count;
+}
+
+uint64_t get_total_pages(void) {
+    return usable_pages;
+}
+
+// Mark every page overlapping [start, end) as used
+static void reserve_range(uintptr_t start, uintptr_t end) {
+    uintptr_t first = start / PAGE_SIZE;
+    uintptr_t last = (end + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (last > total_pages) last = total_pages;
+    for (uintptr_t page = first; page < last; page++) {
+        if (!is_page_used(page)) {
+            set_page_used(page);
+            free_pages--;
+        }
+    }
+}
+
+// Mark every page completely inside [start, end) as free
+static void release_range(uint64_t start, uint64_t end) {
+    uint64_t first = (start + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t last = end / PAGE_SIZE;
+    if (last > total_pages) last = total_pages;
+    for (uint64_t page = first; page < last; page++) {
+        if (is_page_used(page)) {
+            set_page_free(page);
+            free_pages++;
+            usable_pages++;
+        }
+    }
+}
+
+// Usable RAM from the memory map, or a fake 16MB region without one
+static int get_region(int index, uint64_t *start, uint64_t *end) {
+    if (multiboot_memory_region_count() == 0) {
+        if (index > 0) return 0;
+        *start = FALLBACK_BASE;
+        *end = FALLBACK_BASE + FALLBACK_SIZE;
+        return 1;
+    }
+    const struct memory_region *r = multiboot_get_memory_region(index);
+    if (!r) return 0;
+    if (r->type != MEMORY_AVAILABLE || r->base >= MAX_PHYS_ADDR) {
+        *start = *end = 0;
+        return 1;
+    }
+    *start = r->base;
+    *end = r->base + r->length;
+    if (*end > MAX_PHYS_ADDR) *end = MAX_PHYS_ADDR;
+    return 1;
+}
+
+// Push addr past any boot module overlapping [addr, addr + size)
+static uintptr_t skip_modules(uintptr_t addr, size_t size) {
+    int moved = 1;
+    while (moved) {
+        moved = 0;
+        for (int i = 0; i < multiboot_module_count(); i++) {
+            const struct boot_module *m = multiboot_get_module(i);
+            if (addr < m->end && m->start < addr + size) {
+                addr = (m->end + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+                moved = 1;
+            }
+        }
+    }
+    return addr;
+}
+
+// First usable, page-aligned spot of size bytes above the kernel image
+static uintptr_t place_metadata(size_t size) {
+    uintptr_t kernel_end = ((uintptr_t)__kernel_end + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    uint64_t start, end;
+    for (int i = 0; get_region(i, &start, &end); i++) {
+        if (end <= start) continue;
+        uintptr_t addr = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        if (addr < kernel_end) addr = kernel_end;
+        addr = skip_modules(addr, size);
+        if (addr + size <= end) return addr;
+    }
+    return 0;
 }
 
 static void memory_init(void) {
-    // Initialize all pages as free
-    for (size_t i = 0; i < BITMAP_SIZE; i++) {
-        page_bitmap[i] = 0;
+    // Size everything by the highest usable address
+    uint64_t start, end, top = 0;
+    for (int i = 0; get_region(i, &start, &end); i++) {
+        if (end > top) top = end;
+    }
+    total_pages = top / PAGE_SIZE;
+    bitmap_words = (total_pages + 31) / 32;
+    for (int k = 0; k <= MAX_ORDER; k++) free_list[k] = BUDDY_NONE;
+    
+    // Bitmap, buddy links and orders in one block: ~9 bytes per page
+    size_t meta_size = bitmap_words * sizeof(uint32_t) +
+                       total_pages * (2 * sizeof(int32_t) + sizeof(uint8_t));
+    uintptr_t meta = place_metadata(meta_size);
+    if (!meta) {
+        puts("[memory] No room for allocator metadata, allocator disabled\n");
+        total_pages = bitmap_words = 0;
+        return;
+    }
+    page_bitmap = (uint32_t *)meta;
+    buddy_next = (int32_t *)(page_bitmap + bitmap_words);
+    buddy_prev = buddy_next + total_pages;
+    buddy_order = (uint8_t *)(buddy_prev + total_pages);
+    
+    // Everything starts used; only available RAM is released
+    for (size_t i = 0; i < bitmap_words; i++) page_bitmap[i] = 0xFFFFFFFF;
+    for (int i = 0; get_region(i, &start, &end); i++) {
+        if (end > start) release_range(start, end);
     }
+    
+    // Then take back what is already spoken for
+    reserve_range(0, LOW_MEMORY_END);
+    reserve_range((uintptr_t)__kernel_start, (uintptr_t)__kernel_end);
+    reserve_range(meta, meta + meta_size);
+    
+    // Boot modules (the initrd) are used in place, never hand them out
+    for (int i = 0; i < multiboot_module_count(); i++) {
+        const struct boot_module *m = multiboot_get_module(i);
+        reserve_range(m->start, m->end);
+    }
+    
+    // Seed the buddy lists from the bitmap; coalescing builds the
+    // largest aligned blocks on its own
+    for (size_t page = 0; page < total_pages; page++) buddy_order[page] = BUDDY_NOT_HEAD;
+    for (size_t page = 0; page < total_pages; page++) {
+        if (!is_page_used(page)) buddy_free_block(page, 0);
+    }
+    
     puts("[memory] Physical memory manager initialized\n");
     puts("[memory] Managing ");
     char buf[32];
-    itoa_u(TOTAL_PAGES * PAGE_SIZE / 1024, buf);
+    itoa_u(usable_pages * PAGE_SIZE / 1024, buf);
     puts(buf);
-    puts(" KB\n");
+    puts(" KB, ");
+    itoa_u(free_pages * PAGE_SIZE / 1024, buf);
+    puts(buf);
+    puts(" KB free\n");
+    
+    kernel_raise_event(EVENT_MEMORY);  // Fill the zero pool once idle
 }
 
+// Refill the zeroed-page pool a few pages at a time
 static void memory_tick(void) {
-    // Nothing to do each tick
+    for (int i = 0; i < ZERO_POOL_BATCH && zero_pool_count < ZERO_POOL_SIZE; i++) {
+        void *addr = bitmap_alloc();
+        if (!addr) return;
+        zero_page(addr);
+        zero_pool[zero_pool_count++] = addr;
+    }
+    if (zero_pool_count < ZERO_POOL_SIZE) kernel_raise_event(EVENT_MEMORY);
 }
 
 __attribute__((section(".compobjs"))) static struct component memory_component = {
     .name = "memory",
     .init = memory_init,
-    .tick = memory_tick
+    .tick = memory_tick,
+    .wake_events = EVENT_MEMORY
 };
 
 __attribute__((section(".comps"))) struct component *p_memory_component = &memory_component;
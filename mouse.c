@@ -3,6 +3,13 @@
  * PS/2 Mouse driver component
  * Copyright (C) 2025 B."Nova" J.
  * Licensed under GNU GPLv2
+ *
+ * The IRQ handler only queues bytes. mouse_tick() drains the whole
+ * queue, runs each packet through acceleration and smoothing, and then
+ * publishes the result on the input event stream: a button change posts
+ * an INPUT_MOUSE_BUTTON at the packet it arrived in, so a quick click
+ * isn't lost, and motion posts one coalesced INPUT_MOUSE_MOVE per tick.
+ * All of it is 24.8 fixed point, since the kernel never sets up the FPU.
  */
 
 #include <stdint.h>
@@ -12,6 +19,22 @@
 #define MOUSE_STATUS 0x64
 #define MOUSE_ABIT 0x02
 #define MOUSE_BBIT 0x01
+#define MOUSE_IRQ 12
+#define KEYBOARD_IRQ 1
+
+// Raw packet bytes: pushed by the IRQ12 handler, popped by mouse_tick
+SPSC_RING(mouse_ring, uint8_t, 256);
+static struct mouse_ring mouse_bytes;
+static uint32_t mouse_dropped = 0;  // mouse_bytes.dropped as of the last tick
+static uint32_t resync_at = 0;      // Ring position of a gap not yet reached
+static int resync_pending = 0;
+
+#define MOUSE_BATCH 48
+
+#define FIX_SHIFT 8
+#define FIX(n) ((int32_t)(n) << FIX_SHIFT)
+#define SMOOTH_OLD 77    // Weight of the previous velocity, out of 256 (0.3)
+#define ACCEL_THRESHOLD 100  // Squared counts per packet before speeding up
 
 static int mouse_x = 160;  // Center of 320x200
 static int mouse_y = 100;
@@ -19,11 +42,11 @@ static uint8_t mouse_buttons = 0;
 static uint8_t mouse_cycle = 0;
 static uint8_t mouse_byte[3];
 
-// Mouse smoothing
-static float mouse_x_float = 160.0f;
-static float mouse_y_float = 100.0f;
-static float velocity_x = 0.0f;
-static float velocity_y = 0.0f;
+// Smoothing state, 24.8 fixed point
+static int32_t pos_x = FIX(160);
+static int32_t pos_y = FIX(100);
+static int32_t velocity_x = 0;
+static int32_t velocity_y = 0;
 
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -69,9 +92,20 @@ uint8_t mouse_get_buttons(void) {
     return mouse_buttons;
 }
 
+// IRQ12: the controller only raises this for auxiliary-device bytes
+static void mouse_irq_handler(void) {
+    mouse_ring_push(&mouse_bytes, inb(MOUSE_PORT));
+    kernel_raise_event(EVENT_MOUSE);
+}
+
 static void mouse_init(void) {
     uint8_t status;
     
+    // The handshake polls the controller's data port, so neither PS/2
+    // IRQ handler may take the replies; the timer keeps ticking
+    int keyboard_masked = irq_set_masked(KEYBOARD_IRQ, 1);
+    irq_set_masked(MOUSE_IRQ, 1);
+    
     // Enable auxiliary mouse device
     mouse_wait(1);
     outb(MOUSE_STATUS, 0xA8);
@@ -96,17 +130,23 @@ static void mouse_init(void) {
     
     // Reset cycle
     mouse_cycle = 0;
+    irq_set_masked(KEYBOARD_IRQ, keyboard_masked);
+    irq_install_handler(MOUSE_IRQ, mouse_irq_handler);
     
-    puts("[mouse] PS/2 mouse driver initialized\n");
+    puts("[mouse] PS/2 mouse driver initialized (IRQ12)\n");
 }
 
-static void mouse_tick(void) {
-    // Check if mouse has data
-    uint8_t status = inb(MOUSE_STATUS);
-    if ((status & MOUSE_BBIT) == 0) return;
-    
-    uint8_t data = inb(MOUSE_PORT);
-    
+static void post_mouse_event(uint8_t type, int x, int y) {
+    struct input_event ev = { 0 };
+    ev.type = type;
+    ev.buttons = mouse_buttons;
+    ev.x = x;
+    ev.y = y;
+    input_post(&ev);
+}
+
+// Feed one byte into the 3-byte packet state machine
+static void mouse_process_byte(uint8_t data) {
     switch (mouse_cycle) {
         case 0:
             // First byte must have bit 3 set
@@ -128,54 +168,94 @@ static void mouse_tick(void) {
             mouse_cycle = 0;
             
             // Process complete packet
-            mouse_buttons = mouse_byte[0] & 0x07;
-            
-            // Extract movement (convert from uint8_t to signed int)
-            int8_t dx = (int8_t)mouse_byte[1];
-            int8_t dy = (int8_t)mouse_byte[2];
-            
-            // Check for overflow flags
+            uint8_t buttons = mouse_byte[0] & 0x07;
+
+            // Movement is 9-bit two's complement, the sign bits live in
+            // byte 0; an overflowed axis carries no usable count
+            int32_t dx = mouse_byte[1] - ((mouse_byte[0] << 4) & 0x100);
+            int32_t dy = mouse_byte[2] - ((mouse_byte[0] << 3) & 0x100);
             if (mouse_byte[0] & 0x40) dx = 0;  // X overflow
             if (mouse_byte[0] & 0x80) dy = 0;  // Y overflow
-            
-            // Apply acceleration curve
-            float move_x = (float)dy;
-            float move_y = (float)dx;
-            
-            // Acceleration: faster movement = more speed
-            float speed = move_x * move_x + move_y * move_y;
-            if (speed > 100.0f) {
-                float mult = 1.5f;
-                move_x *= mult;
-                move_y *= mult;
+
+            // PS/2 counts up for upward motion, the screen counts down
+            int32_t move_x = FIX(dx);
+            int32_t move_y = FIX(-dy);
+
+            // Acceleration: faster movement = more speed (x1.5)
+            if (dx * dx + dy * dy > ACCEL_THRESHOLD) {
+                move_x += move_x / 2;
+                move_y += move_y / 2;
             }
-            
+
             // Smoothing: blend old velocity with new
-            velocity_x = velocity_x * 0.3f + move_x * 0.7f;
-            velocity_y = velocity_y * 0.3f + move_y * 0.7f;
-            
-            // Update float position
-            mouse_x_float += velocity_x;
-            mouse_y_float += velocity_y;
-            
-            // Clamp float position
-            if (mouse_x_float < 0.0f) mouse_x_float = 0.0f;
-            if (mouse_x_float > 319.0f) mouse_x_float = 319.0f;
-            if (mouse_y_float < 0.0f) mouse_y_float = 0.0f;
-            if (mouse_y_float > 199.0f) mouse_y_float = 199.0f;
-            
-            // Convert to integer
-            mouse_x = (int)mouse_x_float;
-            mouse_y = (int)mouse_y_float;
-            
+            velocity_x = (velocity_x * SMOOTH_OLD + move_x * (256 - SMOOTH_OLD)) / 256;
+            velocity_y = (velocity_y * SMOOTH_OLD + move_y * (256 - SMOOTH_OLD)) / 256;
+
+            pos_x += velocity_x;
+            pos_y += velocity_y;
+
+            int32_t max_x = FIX(vga_get_width() - 1);
+            int32_t max_y = FIX(vga_get_height() - 1);
+            if (pos_x < 0) pos_x = 0;
+            if (pos_x > max_x) pos_x = max_x;
+            if (pos_y < 0) pos_y = 0;
+            if (pos_y > max_y) pos_y = max_y;
+
+            if (buttons != mouse_buttons) {
+                mouse_buttons = buttons;
+                post_mouse_event(INPUT_MOUSE_BUTTON, pos_x >> FIX_SHIFT, pos_y >> FIX_SHIFT);
+            }
             break;
     }
 }
 
+static void mouse_tick(void) {
+    uint8_t batch[MOUSE_BATCH];
+    uint32_t n;
+
+    // A lost byte shifts every packet after it. The bytes still queued
+    // in front of the gap are good; once the decoder gets to the gap,
+    // drop the partial packet and let the bit 3 check find the next
+    // first byte. Only the latest gap is known, earlier ones are left
+    // to the bit 3 check.
+    uint32_t dropped = mouse_ring_dropped(&mouse_bytes);
+    if (dropped != mouse_dropped) {
+        mouse_dropped = dropped;
+        resync_at = mouse_ring_drop_at(&mouse_bytes);
+        resync_pending = 1;
+    }
+
+    // Drain every byte queued since the last tick
+    uint32_t pos = mouse_ring_tail(&mouse_bytes);
+    if (resync_pending && (int32_t)(resync_at - pos) <= 0) {
+        mouse_cycle = 0;    // At the gap already, or it fell mid-drain last tick
+        resync_pending = 0;
+    }
+    while ((n = mouse_ring_pop_n(&mouse_bytes, batch, MOUSE_BATCH)) > 0) {
+        for (uint32_t i = 0; i < n; i++, pos++) {
+            if (resync_pending && pos == resync_at) {
+                mouse_cycle = 0;
+                resync_pending = 0;
+            }
+            mouse_process_byte(batch[i]);
+        }
+    }
+
+    // Publish once per tick however many packets arrived
+    int x = pos_x >> FIX_SHIFT;
+    int y = pos_y >> FIX_SHIFT;
+    if (x == mouse_x && y == mouse_y) return;
+    post_mouse_event(INPUT_MOUSE_MOVE, x, y);
+    mouse_x = x;
+    mouse_y = y;
+}
+
 __attribute__((section(".compobjs"))) static struct component mouse_component = {
     .name = "mouse",
     .init = mouse_init,
-    .tick = mouse_tick
+    .tick = mouse_tick,
+    .wake_events = EVENT_MOUSE,
+    .flags = COMPONENT_DEFERRED  // Controller handshakes can spin for a long time
 };
 
 __attribute__((section(".comps"))) struct component *p_mouse_component = &mouse_component;
@@ -0,0 +1,205 @@
+/* multiboot.c
+ *
+ * Multiboot2 boot information parser for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * kernel_main() hands us the info pointer GRUB left in EBX before any
+ * component runs. Everything components need later is copied into
+ * static storage here, because the info block itself sits in memory
+ * the page allocator is free to reuse.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define MB2_TAG_END 0
+#define MB2_TAG_MODULE 3
+#define MB2_TAG_MMAP 6
+#define MB2_TAG_FRAMEBUFFER 8
+
+typedef struct {
+    uint32_t total_size;
+    uint32_t reserved;
+} __attribute__((packed)) mb2_info_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) mb2_tag_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+} __attribute__((packed)) mb2_tag_module_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+} __attribute__((packed)) mb2_tag_mmap_t;
+
+typedef struct {
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} __attribute__((packed)) mb2_mmap_entry_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint64_t addr;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t fb_type;
+    uint16_t reserved;
+    // Direct RGB color info follows for fb_type 1
+    uint8_t red_pos, red_size;
+    uint8_t green_pos, green_size;
+    uint8_t blue_pos, blue_size;
+} __attribute__((packed)) mb2_tag_framebuffer_t;
+
+static struct boot_module modules[MAX_BOOT_MODULES];
+static char module_cmdlines[MAX_BOOT_MODULES][BOOT_MODULE_CMDLINE];
+static int module_count = 0;
+
+static struct memory_region memory_regions[MAX_MEMORY_REGIONS];
+static int memory_region_count = 0;
+
+static struct boot_framebuffer framebuffer;
+static int have_framebuffer = 0;
+
+static void parse_module(const mb2_tag_module_t *tag) {
+    if (module_count >= MAX_BOOT_MODULES) return;
+
+    struct boot_module *m = &modules[module_count];
+    m->start = tag->mod_start;
+    m->end = tag->mod_end;
+
+    char *cmdline = module_cmdlines[module_count];
+    int i = 0;
+    while (tag->cmdline[i] && i < BOOT_MODULE_CMDLINE - 1) {
+        cmdline[i] = tag->cmdline[i];
+        i++;
+    }
+    cmdline[i] = 0;
+    m->cmdline = cmdline;
+
+    module_count++;
+}
+
+static void parse_mmap(const mb2_tag_mmap_t *tag) {
+    uintptr_t p = (uintptr_t)tag + sizeof(mb2_tag_mmap_t);
+    uintptr_t end = (uintptr_t)tag + tag->size;
+
+    // entry_size may grow in later spec versions, so step by it; a
+    // smaller one is a malformed tag
+    if (tag->entry_size < sizeof(mb2_mmap_entry_t)) {
+        puts("[multiboot] Bad memory map entry size, ignoring map\n");
+        return;
+    }
+    while (p + sizeof(mb2_mmap_entry_t) <= end && memory_region_count < MAX_MEMORY_REGIONS) {
+        const mb2_mmap_entry_t *e = (const mb2_mmap_entry_t *)p;
+        memory_regions[memory_region_count].base = e->base_addr;
+        memory_regions[memory_region_count].length = e->length;
+        memory_regions[memory_region_count].type = e->type;
+        memory_region_count++;
+        p += tag->entry_size;
+    }
+}
+
+static void parse_framebuffer(const mb2_tag_framebuffer_t *tag) {
+    framebuffer.addr = tag->addr;
+    framebuffer.pitch = tag->pitch;
+    framebuffer.width = tag->width;
+    framebuffer.height = tag->height;
+    framebuffer.bpp = tag->bpp;
+    framebuffer.type = tag->fb_type;
+    if (tag->fb_type == FRAMEBUFFER_TYPE_RGB && tag->size >= sizeof(mb2_tag_framebuffer_t)) {
+        framebuffer.red_pos = tag->red_pos;
+        framebuffer.red_size = tag->red_size;
+        framebuffer.green_pos = tag->green_pos;
+        framebuffer.green_size = tag->green_size;
+        framebuffer.blue_pos = tag->blue_pos;
+        framebuffer.blue_size = tag->blue_size;
+    }
+    have_framebuffer = 1;
+}
+
+void multiboot_init(uint32_t magic, uintptr_t info_addr) {
+    if (magic != MULTIBOOT2_BOOTLOADER_MAGIC || info_addr == 0) {
+        puts("[multiboot] No multiboot2 information\n");
+        return;
+    }
+
+    const mb2_info_t *info = (const mb2_info_t *)info_addr;
+    uintptr_t end = info_addr + info->total_size;
+    uintptr_t p = info_addr + sizeof(mb2_info_t);
+
+    while (p + sizeof(mb2_tag_t) <= end) {
+        const mb2_tag_t *tag = (const mb2_tag_t *)p;
+        if (tag->type == MB2_TAG_END) break;
+
+        if (tag->type == MB2_TAG_MODULE) {
+            parse_module((const mb2_tag_module_t *)tag);
+        } else if (tag->type == MB2_TAG_MMAP) {
+            parse_mmap((const mb2_tag_mmap_t *)tag);
+        } else if (tag->type == MB2_TAG_FRAMEBUFFER) {
+            parse_framebuffer((const mb2_tag_framebuffer_t *)tag);
+        }
+
+        // Tags are padded to 8-byte boundaries
+        p += (tag->size + 7) & ~7u;
+    }
+
+    char buf[32];
+    puts("[multiboot] ");
+    itoa_u(module_count, buf);
+    puts(buf);
+    puts(" boot module(s), ");
+    itoa_u(memory_region_count, buf);
+    puts(buf);
+    puts(" memory map entries\n");
+
+    if (have_framebuffer) {
+        puts("[multiboot] Framebuffer ");
+        itoa_u(framebuffer.width, buf);
+        puts(buf);
+        puts("x");
+        itoa_u(framebuffer.height, buf);
+        puts(buf);
+        puts("x");
+        itoa_u(framebuffer.bpp, buf);
+        puts(buf);
+        puts("\n");
+    }
+}
+
+int multiboot_module_count(void) {
+    return module_count;
+}
+
+const struct boot_module *multiboot_get_module(int index) {
+    if (index < 0 || index >= module_count) return NULL;
+    return &modules[index];
+}
+
+int multiboot_memory_region_count(void) {
+    return memory_region_count;
+}
+
+const struct memory_region *multiboot_get_memory_region(int index) {
+    if (index < 0 || index >= memory_region_count) return NULL;
+    return &memory_regions[index];
+}
+
+const struct boot_framebuffer *multiboot_get_framebuffer(void) {
+    return have_framebuffer ? &framebuffer : NULL;
+}
@@ -0,0 +1,145 @@
+/* paging.c
+ *
+ * Identity-mapped paging with per-region memory types for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * Paging exists here only to choose memory types, not to translate:
+ * every virtual address maps to the same physical address, so nothing
+ * else in the kernel has to know it is on. The first 4 MB use 4 KB
+ * pages so the VGA window at 0xA0000 can be typed on its own; the rest
+ * of the 4 GB space is 4 MB PSE pages. There is only ever one address
+ * space, so every mapping is global.
+ *
+ * The PAT is reprogrammed so that PWT alone selects write-combining
+ * instead of write-through. Video memory (the VGA window and the
+ * linear framebuffer) is mapped WC, which lets the CPU merge the
+ * stores of a flush into full bursts instead of issuing one uncached
+ * write at a time. Usable RAM is write-back and everything else, the
+ * local APIC and other MMIO included, is uncacheable.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define PAGE_PRESENT  (1u << 0)
+#define PAGE_WRITE    (1u << 1)
+#define PAGE_PWT      (1u << 3)
+#define PAGE_PCD      (1u << 4)
+#define PAGE_LARGE    (1u << 7)    // PDE: maps 4 MB directly
+#define PAGE_GLOBAL   (1u << 8)
+
+// Memory types, as PAT index bits for both 4 KB and 4 MB entries
+#define TYPE_WB 0                      // PAT entry 0
+#define TYPE_WC PAGE_PWT               // PAT entry 1, reprogrammed below
+#define TYPE_UC (PAGE_PCD | PAGE_PWT)  // PAT entry 3
+
+// PAT entries 0-7: WB, WC, UC-, UC, WB, WT, UC-, UC. Only entry 1
+// differs from the power-on default (WT).
+#define IA32_PAT_MSR 0x277
+#define PAT_VALUE 0x0007040600070106ull
+
+#define CPUID_EDX_PSE (1u << 3)
+#define CPUID_EDX_PGE (1u << 13)
+#define CPUID_EDX_PAT (1u << 16)
+
+#define CR0_PG  (1u << 31)
+#define CR4_PSE (1u << 4)
+#define CR4_PGE (1u << 7)
+
+#define LARGE_PAGE_SIZE 0x400000u
+#define VGA_WINDOW_START 0xA0000u
+#define VGA_WINDOW_END   0xC0000u
+
+static uint32_t page_directory[1024] __attribute__((aligned(4096)));
+static uint32_t low_table[1024] __attribute__((aligned(4096)));  // First 4 MB
+static int paging_on = 0;
+static int have_pat = 0;
+static int have_pge = 0;
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+// Does [start, end) overlap usable RAM from the multiboot memory map?
+static int overlaps_ram(uint64_t start, uint64_t end) {
+    int count = multiboot_memory_region_count();
+    for (int i = 0; i < count; i++) {
+        const struct memory_region *r = multiboot_get_memory_region(i);
+        if (r->type != MEMORY_AVAILABLE) continue;
+        if (r->base < end && r->base + r->length > start) return 1;
+    }
+    // No memory map: assume the 16 MB that memory.c falls back to
+    return count == 0 && start < 16 * 1024 * 1024;
+}
+
+// Pick the memory type for [start, start + size)
+static uint32_t region_type(uint64_t start, uint64_t size, const struct boot_framebuffer *fb) {
+    uint64_t end = start + size;
+    if (fb) {
+        uint64_t fb_end = fb->addr + (uint64_t)fb->pitch * fb->height;
+        if (fb->addr < end && fb_end > start) return TYPE_WC;
+    }
+    return overlaps_ram(start, end) ? TYPE_WB : TYPE_UC;
+}
+
+static void build_tables(void) {
+    const struct boot_framebuffer *fb = multiboot_get_framebuffer();
+    if (fb && fb->type == FRAMEBUFFER_TYPE_EGA_TEXT) fb = NULL;  // That's the VGA window
+    uint32_t global = have_pge ? PAGE_GLOBAL : 0;
+    uint32_t wc = have_pat ? TYPE_WC : TYPE_UC;  // Without PAT, PWT means write-through
+
+    for (uint32_t i = 0; i < 1024; i++) {
+        uint32_t addr = i * 4096;
+        uint32_t type = TYPE_WB;
+        if (addr >= VGA_WINDOW_START && addr < VGA_WINDOW_END) type = wc;
+        low_table[i] = addr | type | global | PAGE_WRITE | PAGE_PRESENT;
+    }
+    page_directory[0] = (uint32_t)low_table | PAGE_WRITE | PAGE_PRESENT;
+
+    for (uint32_t i = 1; i < 1024; i++) {
+        uint32_t addr = i * LARGE_PAGE_SIZE;
+        uint32_t type = region_type(addr, LARGE_PAGE_SIZE, fb);
+        if (type == TYPE_WC) type = wc;
+        page_directory[i] = addr | type | global | PAGE_LARGE | PAGE_WRITE | PAGE_PRESENT;
+    }
+}
+
+// Turn paging on for the calling CPU; APs call this from smp.c
+void paging_enable(void) {
+    if (!paging_on) return;
+    if (have_pat) wrmsr(IA32_PAT_MSR, PAT_VALUE);
+
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_PSE;
+    if (have_pge) cr4 |= CR4_PGE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    __asm__ volatile("mov %0, %%cr3" : : "r"(page_directory) : "memory");
+
+    uint32_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_PG) : "memory");
+}
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_PSE)) {
+        puts("[paging] No 4 MB page support, leaving paging off\n");
+        return;
+    }
+    have_pat = (edx & CPUID_EDX_PAT) != 0;
+    have_pge = (edx & CPUID_EDX_PGE) != 0;
+
+    build_tables();
+    paging_on = 1;
+    paging_enable();
+
+    puts(have_pat ? "[paging] Identity mapped, video memory write-combining\n"
+                  : "[paging] Identity mapped, no PAT so video memory stays uncached\n");
+}
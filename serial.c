@@ -0,0 +1,81 @@
+/* serial.c
+ *
+ * 16550 UART driver for COM1
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * Output only, polled, 115200 8N1 with the FIFO enabled. Nothing here
+ * ever waits on the line: serial_try_putc() refuses a byte while the
+ * transmitter is full, so callers can feed it from the idle path and
+ * pick up where they left off on the next wakeup.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define COM1 0x3F8
+#define UART_DATA 0
+#define UART_IER 1
+#define UART_FCR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_LSR_THRE 0x20  // Transmit FIFO empty (with the FIFO enabled)
+#define UART_FIFO_SIZE 16
+
+static int serial_present = 0;
+static int fifo_room = 0;  // Bytes we can still queue since THRE was last seen
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+void serial_init(void) {
+    outb(COM1 + UART_IER, 0x00);   // No UART interrupts, we poll
+    outb(COM1 + UART_LCR, 0x80);   // DLAB on to set the divisor
+    outb(COM1 + UART_DATA, 0x01);  // 115200 baud
+    outb(COM1 + UART_IER, 0x00);
+    outb(COM1 + UART_LCR, 0x03);   // 8N1, DLAB off
+    outb(COM1 + UART_FCR, 0xC7);   // Enable and clear FIFOs, 14-byte threshold
+
+    // Loopback self-test so a machine without COM1 doesn't eat output
+    outb(COM1 + UART_MCR, 0x1E);
+    outb(COM1 + UART_DATA, 0xAE);
+    if (inb(COM1 + UART_DATA) != 0xAE) {
+        puts("[serial] No UART on COM1\n");
+        return;
+    }
+    outb(COM1 + UART_MCR, 0x0F);   // Normal operation
+    serial_present = 1;
+    puts("[serial] COM1 at 115200 baud\n");
+}
+
+int serial_available(void) {
+    return serial_present;
+}
+
+int serial_try_putc(char c) {
+    if (!serial_present) return 0;
+    if (fifo_room == 0) {
+        // THRE only tells us the FIFO drained, so refill it a whole FIFO at a time
+        if (!(inb(COM1 + UART_LSR) & UART_LSR_THRE)) return 0;
+        fifo_room = UART_FIFO_SIZE;
+    }
+    outb(COM1 + UART_DATA, (uint8_t)c);
+    fifo_room--;
+    return 1;
+}
+
+void serial_write(const char *s) {
+    if (!serial_present) return;
+    while (*s) {
+        while (!serial_try_putc(*s)) __asm__ volatile("pause");
+        s++;
+    }
+}
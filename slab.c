@@ -0,0 +1,281 @@
+/* slab.c
+ *
+ * Slab allocator for small kernel objects
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * Each cache hands out objects of one fixed size carved from whole
+ * pages. A slab is a single page with a small header at the front; the
+ * rest is split into equal objects threaded onto a per-slab freelist.
+ * Slabs with at least one free object sit on the cache's partial list,
+ * so alloc and free are both O(1): alloc pops from the first partial
+ * slab, free finds its slab by rounding the object address down to the
+ * page and pushes it back.
+ *
+ * One completely free slab is kept per cache so an alloc/free pair at a
+ * page boundary doesn't bounce the page through the page allocator.
+ *
+ * kmalloc() sits on top: requests up to KMALLOC_MAX_CLASS bytes are
+ * rounded to a power-of-two size class with its own cache, anything
+ * bigger gets a buddy block with a small header in front. Both kinds
+ * keep a magic at the start of their first page, which is how kfree()
+ * tells them apart without being given a size.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel.h"
+
+#define SLAB_MAGIC 0x51AB0BEC
+#define SLAB_ALIGN 8
+#define LARGE_MAGIC 0x1A46E0BC
+#define MAX_CACHES 32
+
+#define KMALLOC_MIN_SHIFT 4        // Smallest class: 16 bytes
+#define KMALLOC_MAX_SHIFT 10       // Largest class: 1 KB, bigger goes to pages
+#define KMALLOC_MAX_CLASS (1u << KMALLOC_MAX_SHIFT)
+#define KMALLOC_CLASSES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+struct slab {
+    uint32_t magic;
+    struct kmem_cache *cache;
+    struct slab *prev;         // Partial list linkage
+    struct slab *next;
+    void *free;                // First free object in this slab
+    uint32_t inuse;
+};
+
+struct kmem_cache {
+    const char *name;
+    size_t size;               // Object stride, rounded up to SLAB_ALIGN
+    uint32_t per_slab;
+    struct slab *partial;      // Slabs with at least one free object
+    struct slab *spare;        // The one fully free slab we keep around
+    uint32_t slabs;
+    uint32_t objects;
+};
+
+// Header in front of a kmalloc() allocation too big for any class
+struct large_block {
+    uint32_t magic;
+    uint32_t order;
+    uint64_t reserved;         // Keeps the payload SLAB_ALIGN aligned
+};
+
+// Objects start after the header, aligned like the objects themselves
+#define SLAB_HEADER_SIZE ((sizeof(struct slab) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+static struct kmem_cache caches[MAX_CACHES];
+static int cache_count = 0;
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_CLASSES];
+static const char *kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+static void zero_object(void *obj, size_t size) {
+    void *p = obj;
+    size_t count = size / 4;
+    __asm__ volatile("rep stosl" : "+D"(p), "+c"(count) : "a"(0) : "memory");
+}
+
+static struct slab *slab_of(const void *obj) {
+    return (struct slab *)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+static void partial_insert(struct kmem_cache *cache, struct slab *s) {
+    s->prev = NULL;
+    s->next = cache->partial;
+    if (cache->partial) cache->partial->prev = s;
+    cache->partial = s;
+}
+
+static void partial_remove(struct kmem_cache *cache, struct slab *s) {
+    if (s->prev) s->prev->next = s->next;
+    else cache->partial = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->prev = s->next = NULL;
+}
+
+static struct slab *slab_create(struct kmem_cache *cache) {
+    // Objects are zeroed on alloc, so the page doesn't need to be
+    struct slab *s = kalloc_page_nozero();
+    if (!s) return NULL;
+
+    s->magic = SLAB_MAGIC;
+    s->cache = cache;
+    s->prev = s->next = NULL;
+    s->inuse = 0;
+
+    // Thread the freelist front to back so objects come out in address order
+    uint8_t *base = (uint8_t *)s + SLAB_HEADER_SIZE;
+    for (uint32_t i = 0; i < cache->per_slab; i++) {
+        void **obj = (void **)(base + i * cache->size);
+        *obj = (i + 1 < cache->per_slab) ? base + (i + 1) * cache->size : NULL;
+    }
+    s->free = base;
+
+    cache->slabs++;
+    return s;
+}
+
+static void slab_destroy(struct kmem_cache *cache, struct slab *s) {
+    s->magic = 0;
+    cache->slabs--;
+    kfree_page(s);
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size) {
+    if (size == 0) return NULL;
+    if (size < sizeof(void *)) size = sizeof(void *);
+    size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    if (size > PAGE_SIZE - SLAB_HEADER_SIZE) {
+        puts("[slab] Object too large for a slab: ");
+        puts(name);
+        puts("\n");
+        return NULL;
+    }
+    if (cache_count >= MAX_CACHES) {
+        puts("[slab] Out of cache descriptors\n");
+        return NULL;
+    }
+
+    struct kmem_cache *cache = &caches[cache_count++];
+    cache->name = name;
+    cache->size = size;
+    cache->per_slab = (PAGE_SIZE - SLAB_HEADER_SIZE) / size;
+    cache->partial = NULL;
+    cache->spare = NULL;
+    cache->slabs = 0;
+    cache->objects = 0;
+    return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache) {
+    if (!cache) return NULL;
+
+    struct slab *s = cache->partial;
+    if (!s) {
+        s = slab_create(cache);
+        if (!s) return NULL;
+        partial_insert(cache, s);
+    }
+
+    void *obj = s->free;
+    s->free = *(void **)obj;
+    if (s->inuse++ == 0 && s == cache->spare) cache->spare = NULL;
+    if (!s->free) partial_remove(cache, s);
+
+    cache->objects++;
+    zero_object(obj, cache->size);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+    if (!obj) return;
+
+    struct slab *s = slab_of(obj);
+    uintptr_t offset = (uintptr_t)obj - (uintptr_t)s;
+    if (s->magic != SLAB_MAGIC || s->cache != cache ||
+        offset < SLAB_HEADER_SIZE || (offset - SLAB_HEADER_SIZE) % cache->size != 0 ||
+        s->inuse == 0) {
+        puts("[slab] Bad free in cache ");
+        puts(cache ? cache->name : "(null)");
+        puts("\n");
+        return;
+    }
+
+    // A full slab isn't on the partial list; it is about to be
+    if (!s->free) partial_insert(cache, s);
+    *(void **)obj = s->free;
+    s->free = obj;
+    cache->objects--;
+
+    if (--s->inuse == 0) {
+        if (!cache->spare) {
+            cache->spare = s;
+        } else {
+            partial_remove(cache, s);
+            slab_destroy(cache, s);
+        }
+    }
+}
+
+static int size_class(size_t size) {
+    int shift = KMALLOC_MIN_SHIFT;
+    while (((size_t)1 << shift) < size) shift++;
+    return shift - KMALLOC_MIN_SHIFT;
+}
+
+static int large_order(size_t size) {
+    size_t total = size + sizeof(struct large_block);
+    int order = 0;
+    while (((size_t)PAGE_SIZE << order) < total) order++;
+    return order;
+}
+
+// Bytes the caller may use at ptr, which may exceed what was asked for
+static size_t usable_size(const void *ptr) {
+    struct slab *s = slab_of(ptr);
+    if (s->magic == SLAB_MAGIC) return s->cache->size;
+    if (s->magic == LARGE_MAGIC) {
+        const struct large_block *lb = (const struct large_block *)s;
+        return ((size_t)PAGE_SIZE << lb->order) - sizeof(struct large_block);
+    }
+    return 0;
+}
+
+void *kmalloc(size_t size) {
+    if (size == 0) return NULL;
+
+    if (size <= KMALLOC_MAX_CLASS) {
+        int cls = size_class(size);
+        if (!kmalloc_caches[cls]) {
+            kmalloc_caches[cls] = kmem_cache_create(kmalloc_names[cls],
+                                                    (size_t)1 << (cls + KMALLOC_MIN_SHIFT));
+        }
+        return kmem_cache_alloc(kmalloc_caches[cls]);
+    }
+
+    int order = large_order(size);
+    struct large_block *lb = kalloc_pages(order);
+    if (!lb) return NULL;
+    lb->magic = LARGE_MAGIC;
+    lb->order = order;
+    return lb + 1;
+}
+
+void kfree(void *ptr) {
+    if (!ptr) return;
+
+    struct slab *s = slab_of(ptr);
+    if (s->magic == SLAB_MAGIC) {
+        kmem_cache_free(s->cache, ptr);
+    } else if (s->magic == LARGE_MAGIC && ptr == (struct large_block *)s + 1) {
+        struct large_block *lb = (struct large_block *)s;
+        lb->magic = 0;
+        kfree_pages(lb, lb->order);
+    } else {
+        puts("[slab] Bad kfree\n");
+    }
+}
+
+void *krealloc(void *ptr, size_t size) {
+    if (!ptr) return kmalloc(size);
+    if (size == 0) {
+        kfree(ptr);
+        return NULL;
+    }
+
+    size_t old = usable_size(ptr);
+    if (size <= old) return ptr;
+
+    void *p = kmalloc(size);
+    if (!p) return NULL;
+    uint8_t *dst = p;
+    const uint8_t *src = ptr;
+    for (size_t i = 0; i < old; i++) dst[i] = src[i];
+    kfree(ptr);
+    return p;
+}
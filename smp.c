@@ -0,0 +1,296 @@
+/* smp.c
+ *
+ * Application processor bring-up and work-stealing queues for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * smp_init() wakes the other CPUs with the local APIC INIT-SIPI-SIPI
+ * broadcast. Each AP starts in trampoline.S, gets its own stack from
+ * ap_stacks and ends up in ap_main(), where it sleeps in hlt until a
+ * wakeup IPI (IPI_WAKE_VECTOR) says there is work.
+ *
+ * Work lives in one small queue per CPU. smp_parallel() pushes parts
+ * 1..n-1 onto the caller's queue, wakes the APs, runs part 0 itself and
+ * then keeps taking work until every part is done. CPUs pop their own
+ * queue from the tail and steal from other queues' heads, so idle CPUs
+ * spread a job out without any central dispatcher.
+ *
+ * Components keep ticking on the BSP: the allocators, drivers and the
+ * trace source are not safe to use from two CPUs at once. Only work
+ * that touches nothing but its own arguments, like filling or copying
+ * disjoint bands of the back buffer, goes through smp_parallel().
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE (1u << 11)
+#define CPUID_EDX_APIC (1u << 9)
+
+#define LAPIC_ID       0x020
+#define LAPIC_EOI      0x0B0
+#define LAPIC_SVR      0x0F0
+#define LAPIC_ICR_LOW  0x300
+#define LAPIC_ICR_HIGH 0x310
+
+#define SVR_ENABLE       (1u << 8)
+#define ICR_PENDING      (1u << 12)
+#define ICR_ASSERT       (1u << 14)
+#define ICR_ALL_BUT_SELF (3u << 18)
+#define ICR_FIXED        (0u << 8)
+#define ICR_INIT         (5u << 8)
+#define ICR_STARTUP      (6u << 8)
+
+#define TRAMPOLINE_BASE 0x8000    // Must match trampoline.S; SIPI vector 0x08
+#define AP_STACK_SIZE 16384
+#define AP_WAIT_MS 20             // How long the APs get to check in
+
+#define WORK_QUEUE_SIZE 64        // Per CPU; must be a power of two
+
+// Mirrors the block at the end of trampoline.S
+struct trampoline_params {
+    uint16_t gdt_limit;
+    uint32_t gdt_base;
+    uint16_t pad;
+    uint32_t next_cpu;
+    uint32_t max_cpus;
+    uint32_t stack_base;
+    uint32_t stack_size;
+    uint32_t entry;
+} __attribute__((packed));
+
+struct work_item {
+    smp_work_fn fn;
+    void *arg;
+    int part;
+    volatile uint32_t *done;      // Bumped once the part has run
+};
+
+struct work_queue {
+    spinlock_t lock;
+    uint32_t head;                // Thieves take from here
+    uint32_t tail;                // The owner pushes and pops here
+    struct work_item items[WORK_QUEUE_SIZE];
+} __attribute__((aligned(64)));
+
+extern uint8_t trampoline_start[];
+extern uint8_t trampoline_end[];
+extern uint8_t trampoline_params[];
+
+static uint8_t ap_stacks[SMP_MAX_CPUS - 1][AP_STACK_SIZE] __attribute__((aligned(16)));
+static struct work_queue queues[SMP_MAX_CPUS];
+static volatile uint32_t *lapic = 0;
+static uint8_t apic_ids[SMP_MAX_CPUS];
+static volatile int cpu_online[SMP_MAX_CPUS];
+static int cpus_online = 1;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline void cpu_relax(void) {
+    __asm__ volatile("pause" : : : "memory");
+}
+
+static uint8_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+static void lapic_enable(void) {
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+static void send_ipi(uint32_t icr) {
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) cpu_relax();
+    lapic_write(LAPIC_ICR_HIGH, 0);
+    lapic_write(LAPIC_ICR_LOW, icr);
+}
+
+static void delay_ms(uint32_t ms) {
+    uint64_t until = timer_get_ms() + ms + 1;  // +1: we may be just before a tick
+    while (timer_get_ms() < until) cpu_relax();
+}
+
+/* ------------------------------
+   Work queues
+   ------------------------------ */
+
+static int queue_push(struct work_queue *q, const struct work_item *w) {
+    spin_lock(&q->lock);
+    int ok = q->tail - q->head < WORK_QUEUE_SIZE;
+    if (ok) q->items[q->tail++ & (WORK_QUEUE_SIZE - 1)] = *w;
+    spin_unlock(&q->lock);
+    return ok;
+}
+
+// Owner side: newest first, its data is most likely still in cache
+static int queue_pop(struct work_queue *q, struct work_item *w) {
+    if (q->head == q->tail) return 0;     // Unlocked peek, rechecked below
+    spin_lock(&q->lock);
+    int ok = q->head != q->tail;
+    if (ok) *w = q->items[--q->tail & (WORK_QUEUE_SIZE - 1)];
+    spin_unlock(&q->lock);
+    return ok;
+}
+
+// Thief side: oldest first
+static int queue_steal(struct work_queue *q, struct work_item *w) {
+    if (q->head == q->tail) return 0;
+    spin_lock(&q->lock);
+    int ok = q->head != q->tail;
+    if (ok) *w = q->items[q->head++ & (WORK_QUEUE_SIZE - 1)];
+    spin_unlock(&q->lock);
+    return ok;
+}
+
+static int work_pending(void) {
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        if (queues[i].head != queues[i].tail) return 1;
+    }
+    return 0;
+}
+
+// Run one item from our own queue, or steal one; 0 if there was none
+static int run_one(int cpu) {
+    struct work_item w;
+    int found = queue_pop(&queues[cpu], &w);
+    for (int i = 1; !found && i < SMP_MAX_CPUS; i++) {
+        found = queue_steal(&queues[(cpu + i) % SMP_MAX_CPUS], &w);
+    }
+    if (!found) return 0;
+    w.fn(w.arg, w.part);
+    __atomic_fetch_add(w.done, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int smp_cpu_count(void) {
+    return cpus_online;
+}
+
+int smp_cpu_id(void) {
+    if (cpus_online == 1) return 0;
+    uint8_t id = lapic_id();
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        if (cpu_online[i] && apic_ids[i] == id) return i;
+    }
+    return 0;
+}
+
+void smp_parallel(smp_work_fn fn, void *arg, int parts) {
+    if (cpus_online == 1 || parts <= 1) {
+        for (int i = 0; i < parts; i++) fn(arg, i);
+        return;
+    }
+
+    int cpu = smp_cpu_id();
+    volatile uint32_t done = 0;
+    for (int i = 1; i < parts; i++) {
+        struct work_item w = { fn, arg, i, &done };
+        if (!queue_push(&queues[cpu], &w)) {
+            fn(arg, i);               // Queue full, do it ourselves
+            __atomic_fetch_add(&done, 1, __ATOMIC_RELEASE);
+        }
+    }
+    send_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_FIXED | IPI_WAKE_VECTOR);
+
+    fn(arg, 0);
+    __atomic_fetch_add(&done, 1, __ATOMIC_RELEASE);
+
+    // Help with whatever is left rather than spin; parts stolen by other
+    // CPUs finish on their own
+    while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < (uint32_t)parts) {
+        if (!run_one(cpu)) cpu_relax();
+    }
+}
+
+// Wakeup IPI; getting out of hlt is all it is for
+void smp_ipi_handler(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* ------------------------------
+   Bring-up
+   ------------------------------ */
+
+static void ap_main(int cpu) {
+    paging_enable();
+    interrupts_load();
+    lapic_enable();
+    apic_ids[cpu] = lapic_id();
+    __atomic_store_n(&cpu_online[cpu], 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&cpus_online, 1, __ATOMIC_RELEASE);
+
+    for (;;) {
+        if (run_one(cpu)) continue;
+        // sti;hlt is atomic, so a wakeup sent after the check still lands
+        interrupts_disable();
+        if (work_pending()) interrupts_enable();
+        else __asm__ volatile("sti; hlt" : : : "memory");
+    }
+}
+
+void smp_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_APIC)) {
+        puts("[smp] No local APIC, running on one CPU\n");
+        return;
+    }
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+    lapic = (volatile uint32_t *)(uintptr_t)(base & 0xFFFFF000);
+    lapic_enable();
+    apic_ids[0] = lapic_id();
+    cpu_online[0] = 1;
+
+    // The trampoline runs from low memory, which memory.c never hands out
+    uint8_t *dst = (uint8_t *)TRAMPOLINE_BASE;
+    for (uint8_t *src = trampoline_start; src < trampoline_end; src++) *dst++ = *src;
+
+    struct trampoline_params *params = (struct trampoline_params *)
+        (TRAMPOLINE_BASE + (trampoline_params - trampoline_start));
+    struct { uint16_t limit; uint32_t base; } __attribute__((packed)) gdtr;
+    __asm__ volatile("sgdt %0" : "=m"(gdtr));
+    params->gdt_limit = gdtr.limit;
+    params->gdt_base = gdtr.base;
+    params->next_cpu = 1;                     // The BSP is CPU 0
+    params->max_cpus = SMP_MAX_CPUS;
+    params->stack_base = (uint32_t)ap_stacks;  // CPU n's stack is ap_stacks[n - 1]
+    params->stack_size = AP_STACK_SIZE;
+    params->entry = (uint32_t)ap_main;
+
+    // INIT, then two SIPIs as the MP spec asks for
+    send_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+    delay_ms(10);
+    for (int i = 0; i < 2; i++) {
+        send_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_STARTUP | (TRAMPOLINE_BASE >> 12));
+        delay_ms(1);
+    }
+    delay_ms(AP_WAIT_MS);
+
+    char buf[16];
+    puts("[smp] ");
+    itoa_u(__atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE), buf);
+    puts(buf);
+    puts(" CPU(s) online\n");
+}
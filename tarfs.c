@@ -5,13 +5,60 @@
  * Licensed under GNU GPLv2
  *
  * TAR format: 512-byte headers followed by file data
+ *
+ * fs_set_initrd() does no parsing itself. The archive is indexed
+ * TARFS_CHUNK_HEADERS headers per tick, the tick re-raising EVENT_TARFS
+ * until it reaches the end, so boot time doesn't grow with the initrd.
+ * A lookup that misses while indexing is still under way parses ahead
+ * until the name turns up; listings show what has been indexed so far
+ * and fs_ready() says whether that is everything. GNU long names ('L')
+ * and pax extended headers ('x', path and size) apply to the header
+ * that follows them.
+ *
+ * The initrd may also be a compressed container (tools/mkinitrdz.py):
+ *
+ *   "OCZ1" | block_size | raw_size | block_count |
+ *   offset[block_count + 1] | LZ4 blocks
+ *
+ * All fields are little-endian uint32. The tar is cut into block_size
+ * pieces (a multiple of 512, so no tar header straddles two), each an
+ * LZ4 raw block, or stored as is when that is no smaller; offset[] is
+ * where each one starts in the image. Decompressed blocks live in a
+ * small LRU cache bounded by TARFS_CACHE_PAGES.
+ *
+ * Callers get one contiguous pointer per file, so a compressed file is
+ * copied out of the blocks into kmalloc() memory when it is read, and a
+ * compressed file can be at most one buddy block (4 MB). Each copy is
+ * reference counted: fs_read_file() takes a reference, fs_release_file()
+ * drops it. Copies nobody holds stay cached, LRU, within
+ * TARFS_FILE_BUDGET bytes; held copies are never evicted.
  */
 
 #include <stdint.h>
 #include "kernel.h"
 
 #define TAR_BLOCK_SIZE 512
-#define MAX_FILES 32
+#define MAX_NAME 128
+
+// Entry and bucket tables live in pages from kalloc_page(); these
+// directories of page pointers bound the archive at MAX_ENTRY_PAGES *
+// ENTRIES_PER_PAGE entries (12,288 with 168-byte entries)
+#define MAX_ENTRY_PAGES 512
+#define MAX_BUCKET_PAGES 16
+#define BUCKETS_PER_PAGE (PAGE_SIZE / sizeof(int32_t))
+#define NO_ENTRY (-1)
+#define TARFS_CHUNK_HEADERS 64  // Headers indexed per tick or lookup miss
+
+#ifndef TARFS_CACHE_PAGES
+#define TARFS_CACHE_PAGES 64    // Budget for decompressed blocks (256 KB)
+#endif
+#define MAX_CACHED_BLOCKS 16
+#ifndef TARFS_FILE_BUDGET
+#define TARFS_FILE_BUDGET (1024 * 1024)  // For decompressed files nobody holds
+#endif
+#define MAX_FILE_COPIES 32
+#define OCZ_MAGIC 0x315A434F    // "OCZ1"
+#define OCZ_HEADER_SIZE 16
 
 typedef struct {
     char name[100];
@@ -33,16 +80,85 @@ typedef struct {
 } __attribute__((packed)) tar_header_t;
 
 typedef struct {
-    char name[128];
+    char name[MAX_NAME];
     uint32_t size;
-    uint8_t *data;
+    uint8_t *data;          // NULL for compressed archives, see copies[]
+    uint32_t offset;        // Where data starts in the uncompressed tar
     int is_dir;
+    uint32_t hash;          // FNV-1a of name without trailing '/'
+    int32_t next_hash;      // Next entry in the same hash bucket
+    int32_t parent;         // Containing directory, NO_ENTRY for the root
+    int32_t first_child;    // First entry directly inside this directory
+    int32_t last_child;     // Tail of that list, so listings keep archive order
+    int32_t next_sibling;   // Next entry in the same directory
 } file_entry_t;
 
-static file_entry_t files[MAX_FILES];
+#define ENTRIES_PER_PAGE (PAGE_SIZE / sizeof(file_entry_t))
+
+static file_entry_t *entry_pages[MAX_ENTRY_PAGES];
+static int entry_page_count = 0;
 static int file_count = 0;
+
+static int32_t *bucket_pages[MAX_BUCKET_PAGES];
+static uint32_t bucket_count = 0;  // Always a power of two
+static int32_t root_first_child = NO_ENTRY;
+static int32_t root_last_child = NO_ENTRY;
+
 static uint8_t *initrd_start = NULL;
-static uint32_t initrd_size = 0;
+static uint32_t initrd_size = 0;    // Size of the tar, even when compressed
+
+// Compressed container state; see the top of the file
+static int compressed = 0;
+static uint8_t *image_start = NULL;
+static uint32_t image_size = 0;
+static uint32_t block_size = 0;
+static uint32_t block_count = 0;
+static int block_order = 0;         // kalloc_pages() order of one block
+
+typedef struct {
+    uint32_t index;                 // Block held, or NO_BLOCK
+    uint32_t last_used;
+    uint8_t *data;
+} cached_block_t;
+
+#define NO_BLOCK 0xFFFFFFFFu
+static cached_block_t cache[MAX_CACHED_BLOCKS];
+static int cache_slots = 0;         // How many blocks the budget allows
+static int cache_used = 0;
+static uint32_t cache_clock = 0;
+
+// Decompressed file copies; see the top of the file
+typedef struct {
+    int32_t entry;                  // File the copy is of; NO_ENTRY once orphaned
+    uint32_t refs;                  // Readers that haven't released it
+    uint32_t last_used;
+    uint32_t size;
+    uint8_t *data;                  // NULL: slot free
+} file_copy_t;
+
+static file_copy_t copies[MAX_FILE_COPIES];
+static uint32_t idle_copy_bytes = 0;  // Sum over copies with no references
+static uint32_t copy_clock = 0;
+
+// Records that cross a block boundary are copied together here
+static uint8_t scratch[2 * TAR_BLOCK_SIZE];
+
+// Incremental parse state
+static uint32_t parse_offset = 0;   // Next header to look at
+static int parse_done = 1;
+static char long_name[MAX_NAME];    // Name for the next entry, from 'L' or 'x'
+static int long_name_len = 0;       // 0: use the header's own name
+static uint32_t pax_size = 0;       // Size for the next entry, from 'x'
+static int has_pax_size = 0;
+
+static inline file_entry_t *entry(int index) {
+    return &entry_pages[index / ENTRIES_PER_PAGE][index % ENTRIES_PER_PAGE];
+}
+
+static inline int32_t *bucket(uint32_t hash) {
+    uint32_t slot = hash & (bucket_count - 1);
+    return &bucket_pages[slot / BUCKETS_PER_PAGE][slot % BUCKETS_PER_PAGE];
+}
 
 // Convert octal string to integer
 static uint32_t parse_octal(const char *str, int len) {
@@ -62,38 +178,555 @@ static void safe_strcpy(char *dest, const char *src, int max_len) {
     dest[i] = 0;
 }
 
-// Parse TAR archive
-static void parse_tar(uint8_t *tar_data, uint32_t size) {
-    uint8_t *ptr = tar_data;
+// Length of a path ignoring one trailing '/' ("docs/" and "docs" match)
+static int path_len(const char *path, int max_len) {
+    int len = 0;
+    while (len < max_len && path[len]) len++;
+    if (len > 0 && path[len - 1] == '/') len--;
+    return len;
+}
+
+static uint32_t hash_path(const char *path, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (uint8_t)path[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t read_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Decode one LZ4 raw block; returns the number of bytes produced, or
+// -1 if the input is malformed or wouldn't fit in dst
+static int lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len) {
+    const uint8_t *ip = src, *ip_end = src + src_len;
+    uint8_t *op = dst, *op_end = dst + dst_len;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        uint32_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (uint32_t)(ip_end - ip) || lit > (uint32_t)(op_end - op)) return -1;
+        for (uint32_t i = 0; i < lit; i++) *op++ = *ip++;
+        if (ip == ip_end) break;  // The last sequence has no match
+
+        if (ip_end - ip < 2) return -1;
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) return -1;
+
+        uint32_t len = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (uint32_t)(op_end - op)) return -1;
+        // Byte at a time: the match may overlap what it produces
+        const uint8_t *match = op - offset;
+        for (uint32_t i = 0; i < len; i++) *op++ = *match++;
+    }
+    return (int)(op - dst);
+}
+
+static void drop_cache(void) {
+    for (int i = 0; i < cache_used; i++) kfree_pages(cache[i].data, block_order);
+    cache_used = 0;
+}
+
+// Decompressed contents of block i, through the LRU cache; NULL if it is corrupt
+static const uint8_t *get_block(uint32_t index) {
+    cached_block_t *slot = NULL;
+    for (int i = 0; i < cache_used; i++) {
+        if (cache[i].index == index) {
+            cache[i].last_used = ++cache_clock;
+            return cache[i].data;
+        }
+    }
+
+    if (cache_used < cache_slots) {
+        uint8_t *data = kalloc_pages(block_order);
+        if (data) {
+            slot = &cache[cache_used++];
+            slot->data = data;
+        }
+    }
+    if (!slot) {
+        // Budget spent (or no memory): reuse the least recently used block
+        if (cache_used == 0) return NULL;
+        slot = &cache[0];
+        for (int i = 1; i < cache_used; i++) {
+            if (cache[i].last_used < slot->last_used) slot = &cache[i];
+        }
+    }
+    slot->index = NO_BLOCK;
+    if (index >= block_count) return NULL;
+
+    const uint8_t *offsets = image_start + OCZ_HEADER_SIZE;
+    uint32_t start = read_le32(offsets + index * 4);
+    uint32_t end = read_le32(offsets + index * 4 + 4);
+    if (start > end || end > image_size) return NULL;
+
+    uint32_t raw = initrd_size - index * block_size;
+    if (raw > block_size) raw = block_size;
+    const uint8_t *src = image_start + start;
+    if (end - start == raw) {
+        for (uint32_t i = 0; i < raw; i++) slot->data[i] = src[i];  // Stored
+    } else if (lz4_decompress(src, end - start, slot->data, raw) != (int)raw) {
+        return NULL;
+    }
+
+    slot->index = index;
+    slot->last_used = ++cache_clock;
+    return slot->data;
+}
+
+// Copy len bytes of the tar at offset into dst
+static int archive_read(uint32_t offset, uint8_t *dst, uint32_t len) {
+    if (!compressed) {
+        for (uint32_t i = 0; i < len; i++) dst[i] = initrd_start[offset + i];
+        return 1;
+    }
+    while (len > 0) {
+        const uint8_t *block = get_block(offset / block_size);
+        if (!block) return 0;
+        uint32_t in_block = offset % block_size;
+        uint32_t n = block_size - in_block;
+        if (n > len) n = len;
+        for (uint32_t i = 0; i < n; i++) dst[i] = block[in_block + i];
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+    return 1;
+}
+
+// Pointer to len bytes of the tar at offset (len <= sizeof(scratch) when
+// compressed). Only valid until the next call: it may be a cache block
+// or scratch.
+static const uint8_t *archive_at(uint32_t offset, uint32_t len) {
+    if (!compressed) return initrd_start + offset;
+    if (offset % block_size + len <= block_size) {
+        const uint8_t *block = get_block(offset / block_size);
+        return block ? block + offset % block_size : NULL;
+    }
+    return archive_read(offset, scratch, len) ? scratch : NULL;
+}
+
+static void free_copy(file_copy_t *c) {
+    if (c->refs == 0) idle_copy_bytes -= c->size;
+    kfree(c->data);
+    c->data = NULL;
+    c->entry = NO_ENTRY;
+    c->refs = 0;
+}
+
+// Unlink a file from its copy; a copy someone still holds lives on
+// until fs_release_file()
+static void detach_copy(int index) {
+    for (int i = 0; i < MAX_FILE_COPIES; i++) {
+        file_copy_t *c = &copies[i];
+        if (!c->data || c->entry != index) continue;
+        if (c->refs == 0) free_copy(c);
+        else c->entry = NO_ENTRY;
+        return;
+    }
+}
+
+// Evict the least recently used copy nobody holds; 0 if there is none
+static int evict_copy(void) {
+    file_copy_t *victim = NULL;
+    for (int i = 0; i < MAX_FILE_COPIES; i++) {
+        file_copy_t *c = &copies[i];
+        if (c->data && c->refs == 0 && (!victim || c->last_used < victim->last_used))
+            victim = c;
+    }
+    if (!victim) return 0;
+    free_copy(victim);
+    return 1;
+}
+
+// Drop every table page so the archive can be parsed again
+static void reset_index(void) {
+    // Copies of the old archive's files go too; held ones once released
+    for (int i = 0; i < MAX_FILE_COPIES; i++) {
+        if (!copies[i].data) continue;
+        if (copies[i].refs == 0) free_copy(&copies[i]);
+        else copies[i].entry = NO_ENTRY;
+    }
+    for (int i = 0; i < entry_page_count; i++) kfree_page(entry_pages[i]);
+    for (uint32_t i = 0; i * BUCKETS_PER_PAGE < bucket_count; i++) kfree_page(bucket_pages[i]);
+    entry_page_count = 0;
     file_count = 0;
-    
-    while (ptr < tar_data + size && file_count < MAX_FILES) {
-        tar_header_t *header = (tar_header_t *)ptr;
-        
-        // Check for end of archive (null header)
-        if (header->name[0] == 0) break;
-        
-        // Check magic number
-        if (header->magic[0] != 'u' || header->magic[1] != 's' ||
-            header->magic[2] != 't' || header->magic[3] != 'a' ||
-            header->magic[4] != 'r') {
-            // Try old tar format (no magic)
-            if (header->name[0] == 0) break;
+    bucket_count = 0;
+    root_first_child = NO_ENTRY;
+    root_last_child = NO_ENTRY;
+}
+
+// Double the bucket table (or create it) and rehash every entry
+static int grow_buckets(void) {
+    uint32_t new_count = bucket_count ? bucket_count * 2 : BUCKETS_PER_PAGE;
+    uint32_t new_pages = new_count / BUCKETS_PER_PAGE;
+    if (new_pages > MAX_BUCKET_PAGES) return 0;
+
+    uint32_t old_pages = bucket_count / BUCKETS_PER_PAGE;
+    for (uint32_t i = old_pages; i < new_pages; i++) {
+        bucket_pages[i] = kalloc_page();
+        if (!bucket_pages[i]) {
+            while (i-- > old_pages) kfree_page(bucket_pages[i]);
+            return 0;
         }
+    }
+
+    bucket_count = new_count;
+    for (uint32_t i = 0; i < new_pages; i++) {
+        for (uint32_t j = 0; j < BUCKETS_PER_PAGE; j++) bucket_pages[i][j] = NO_ENTRY;
+    }
+    for (int i = 0; i < file_count; i++) {
+        int32_t *head = bucket(entry(i)->hash);
+        entry(i)->next_hash = *head;
+        *head = i;
+    }
+    return 1;
+}
+
+// Hash lookup of a path of the given length
+static int find_entry(const char *path, int len) {
+    if (bucket_count == 0) return NO_ENTRY;
+    uint32_t h = hash_path(path, len);
+    for (int32_t i = *bucket(h); i != NO_ENTRY; i = entry(i)->next_hash) {
+        file_entry_t *e = entry(i);
+        if (e->hash != h || path_len(e->name, MAX_NAME) != len) continue;
+        int j = 0;
+        while (j < len && e->name[j] == path[j]) j++;
+        if (j == len) return i;
+    }
+    return NO_ENTRY;
+}
+
+static int add_entry(const char *name, int name_len, uint8_t *data, uint32_t size, int is_dir);
+
+// Directory that contains a path, created on the fly if the archive
+// has no explicit entry for it
+static int32_t parent_of(const char *name, int len) {
+    int slash = len - 1;
+    while (slash >= 0 && name[slash] != '/') slash--;
+    if (slash <= 0) return NO_ENTRY;
+
+    int parent = find_entry(name, slash);
+    if (parent != NO_ENTRY) return parent;
+    return add_entry(name, slash, NULL, 0, 1);
+}
+
+// Append an entry and link it into the hash and directory indexes
+static int add_entry(const char *name, int name_len, uint8_t *data, uint32_t size, int is_dir) {
+    if (name_len >= MAX_NAME) name_len = MAX_NAME - 1;
+    int len = name_len;
+    if (len > 0 && name[len - 1] == '/') len--;
+    if (len == 0) return NO_ENTRY;
+
+    // Directories can show up after their children were indexed
+    int existing = find_entry(name, len);
+    if (existing != NO_ENTRY) {
+        if (!is_dir) {
+            if (compressed) detach_copy(existing);
+            entry(existing)->data = data;
+            entry(existing)->size = size;
+        }
+        return existing;
+    }
+
+    int32_t parent = parent_of(name, len);
+
+    if (file_count == entry_page_count * (int)ENTRIES_PER_PAGE) {
+        if (entry_page_count == MAX_ENTRY_PAGES) return NO_ENTRY;
+        file_entry_t *page = kalloc_page();
+        if (!page) return NO_ENTRY;
+        entry_pages[entry_page_count++] = page;
+    }
+    if ((uint32_t)file_count >= bucket_count && !grow_buckets()) return NO_ENTRY;
+
+    int index = file_count++;
+    file_entry_t *e = entry(index);
+    int i;
+    for (i = 0; i < name_len; i++) e->name[i] = name[i];
+    e->name[i] = 0;
+    if (is_dir && name[name_len - 1] != '/' && i < MAX_NAME - 1) {
+        e->name[i++] = '/';
+        e->name[i] = 0;
+    }
+    e->size = size;
+    e->data = data;
+    e->offset = 0;
+    e->is_dir = is_dir;
+    e->hash = hash_path(name, len);
+
+    int32_t *head = bucket(e->hash);
+    e->next_hash = *head;
+    *head = index;
+
+    e->parent = parent;
+    e->first_child = NO_ENTRY;
+    e->last_child = NO_ENTRY;
+    e->next_sibling = NO_ENTRY;
+    int32_t *first = parent == NO_ENTRY ? &root_first_child : &entry(parent)->first_child;
+    int32_t *last = parent == NO_ENTRY ? &root_last_child : &entry(parent)->last_child;
+    if (*last == NO_ENTRY) *first = index;
+    else entry(*last)->next_sibling = index;
+    *last = index;
+    return index;
+}
+
+static void finish_parse(void) {
+    parse_done = 1;
+    long_name_len = 0;
+    has_pax_size = 0;
+
+    puts("[tarfs] Initrd indexed, ");
+    char buf[32];
+    itoa_u(file_count, buf);
+    puts(buf);
+    puts(" entries\n");
+}
+
+// Keep a name for the next entry; a pax path wins over a GNU long name
+static void set_long_name(const uint8_t *src, uint32_t len) {
+    int n = 0;
+    while ((uint32_t)n < len && src[n] && n < MAX_NAME - 1) {
+        long_name[n] = src[n];
+        n++;
+    }
+    long_name_len = n;
+}
+
+// Pull "path" and "size" out of pax records: "<len> <key>=<value>\n"
+static void parse_pax(const uint8_t *data, uint32_t size) {
+    uint32_t pos = 0;
+    while (pos < size) {
+        uint32_t len = 0, i = pos;
+        while (i < size && data[i] >= '0' && data[i] <= '9') len = len * 10 + (data[i++] - '0');
+        if (i >= size || data[i] != ' ' || len == 0 || len > size - pos) return;
         
-        uint32_t file_size = parse_octal(header->size, 12);
-        
-        // Store file info
-        safe_strcpy(files[file_count].name, header->name, 128);
-        files[file_count].size = file_size;
-        files[file_count].data = ptr + TAR_BLOCK_SIZE;
-        files[file_count].is_dir = (header->typeflag == '5');
-        
-        file_count++;
-        
-        // Move to next entry (header + data, rounded up to 512 bytes)
-        uint32_t blocks = (file_size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
-        ptr += TAR_BLOCK_SIZE + (blocks * TAR_BLOCK_SIZE);
+        const uint8_t *key = data + i + 1;
+        const uint8_t *end = data + pos + len - 1;  // The record's '\n'
+        const uint8_t *eq = key;
+        while (eq < end && *eq != '=') eq++;
+        if (eq < end) {
+            const uint8_t *value = eq + 1;
+            int key_len = eq - key;
+            if (key_len == 4 && key[0] == 'p' && key[1] == 'a' && key[2] == 't' && key[3] == 'h') {
+                set_long_name(value, end - value);
+            } else if (key_len == 4 && key[0] == 's' && key[1] == 'i' && key[2] == 'z' &&
+                       key[3] == 'e') {
+                pax_size = 0;
+                for (const uint8_t *v = value; v < end && *v >= '0' && *v <= '9'; v++)
+                    pax_size = pax_size * 10 + (*v - '0');
+                has_pax_size = 1;
+            }
+        }
+        pos += len;
+    }
+}
+
+// Index the header at parse_offset and step past its data; 0 once the
+// archive is exhausted
+static int parse_header(void) {
+    if (parse_done) return 0;
+    if (initrd_size - parse_offset < TAR_BLOCK_SIZE) {
+        finish_parse();
+        return 0;
+    }
+    
+    uint32_t header_offset = parse_offset;
+    const tar_header_t *header = (const tar_header_t *)archive_at(header_offset, TAR_BLOCK_SIZE);
+    if (!header) {
+        puts("[tarfs] Corrupt compressed block, ignoring remaining entries\n");
+        finish_parse();
+        return 0;
+    }
+    
+    // Check for end of archive (null header)
+    if (header->name[0] == 0) {
+        finish_parse();
+        return 0;
+    }
+    
+    uint32_t file_size = parse_octal(header->size, 12);
+    if (header->typeflag != 'x' && header->typeflag != 'g' && has_pax_size) {
+        file_size = pax_size;
+    }
+    // A member running off the end of the image is cut short
+    uint32_t room = initrd_size - header_offset - TAR_BLOCK_SIZE;
+    if (file_size > room) file_size = room;
+    
+    // Move to next entry (header + data, rounded up to 512 bytes)
+    uint32_t blocks = (file_size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+    parse_offset += TAR_BLOCK_SIZE + (blocks * TAR_BLOCK_SIZE);
+    if (parse_offset > initrd_size) parse_offset = initrd_size;
+    
+    uint32_t data_offset = header_offset + TAR_BLOCK_SIZE;
+    char typeflag = header->typeflag;
+    if (typeflag == 'L' || typeflag == 'x') {
+        // Compressed, the header may live in a cache block that reading
+        // this evicts, and archive_at() can only hand out a scratch-sized
+        // record; a plain tar is read in place at any size
+        uint32_t len = file_size;
+        if (compressed && len > sizeof(scratch)) len = sizeof(scratch);
+        const uint8_t *data = archive_at(data_offset, len);
+        if (!data) return 1;
+        if (typeflag == 'L') {
+            // GNU long name: the data is the next entry's path
+            if (!long_name_len) set_long_name(data, len);
+        } else {
+            // pax extended header for the next entry
+            parse_pax(data, len);
+        }
+        return 1;
+    }
+    switch (typeflag) {
+        case 'g':  // pax global header, GNU long link name: nothing we use
+        case 'K':
+            return 1;
+    }
+    
+    char name[MAX_NAME];
+    int n = 0;
+    if (long_name_len) {
+        for (; n < long_name_len; n++) name[n] = long_name[n];
+    } else {
+        // ustar splits long paths into prefix + "/" + name; neither
+        // field is NUL-terminated when full
+        int is_ustar = header->magic[0] == 'u' && header->magic[1] == 's' &&
+                       header->magic[2] == 't' && header->magic[3] == 'a' &&
+                       header->magic[4] == 'r';
+        if (is_ustar && header->prefix[0]) {
+            for (int i = 0; i < (int)sizeof(header->prefix) && header->prefix[i] &&
+                            n < MAX_NAME - 2; i++) {
+                name[n++] = header->prefix[i];
+            }
+            name[n++] = '/';
+        }
+        for (int i = 0; i < (int)sizeof(header->name) && header->name[i] &&
+                        n < MAX_NAME - 1; i++) {
+            name[n++] = header->name[i];
+        }
+    }
+    name[n] = 0;
+    long_name_len = 0;
+    has_pax_size = 0;
+    
+    // Archives made with "tar -C dir ." prefix everything with "./"
+    const char *stored = name;
+    if (stored[0] == '.' && stored[1] == '/') stored += 2;
+    int stored_len = 0;
+    while (stored[stored_len]) stored_len++;
+    
+    if (stored_len == 0) return 1;
+    
+    uint8_t *data = compressed ? NULL : initrd_start + data_offset;
+    int index = add_entry(stored, stored_len, data, file_size, typeflag == '5');
+    if (index == NO_ENTRY) {
+        puts("[tarfs] Index full, ignoring remaining entries\n");
+        finish_parse();
+        return 0;
+    }
+    if (typeflag != '5') entry(index)->offset = data_offset;
+    return 1;
+}
+
+// Index up to max headers; returns whether there is more to do
+static int parse_chunk(int max) {
+    for (int i = 0; i < max; i++) {
+        if (!parse_header()) return 0;
+    }
+    return !parse_done;
+}
+
+int fs_ready(void) {
+    return parse_done;
+}
+
+// Finish indexing now rather than over the next ticks
+void fs_wait_ready(void) {
+    while (parse_header());
+}
+
+// Find or make the copy of a compressed file, taking a reference
+static uint8_t *copy_file(int index) {
+    file_entry_t *e = entry(index);
+    for (int i = 0; i < MAX_FILE_COPIES; i++) {
+        file_copy_t *c = &copies[i];
+        if (!c->data || c->entry != index) continue;
+        if (c->refs++ == 0) idle_copy_bytes -= c->size;
+        c->last_used = ++copy_clock;
+        return c->data;
+    }
+
+    file_copy_t *slot = NULL;
+    for (int i = 0; !slot && i < MAX_FILE_COPIES; i++) {
+        if (!copies[i].data) slot = &copies[i];
+    }
+    if (!slot && evict_copy()) {
+        for (int i = 0; !slot && i < MAX_FILE_COPIES; i++) {
+            if (!copies[i].data) slot = &copies[i];
+        }
+    }
+    if (!slot) return NULL;     // Every slot held by a reader
+
+    // Idle copies are a cache; give their memory up before failing
+    uint8_t *buf = kmalloc(e->size);
+    while (!buf && evict_copy()) buf = kmalloc(e->size);
+    if (!buf) return NULL;
+    if (!archive_read(e->offset, buf, e->size)) {
+        kfree(buf);
+        return NULL;
+    }
+    slot->entry = index;
+    slot->refs = 1;
+    slot->last_used = ++copy_clock;
+    slot->size = e->size;
+    slot->data = buf;
+    return buf;
+}
+
+// Hand out a file's bytes, decompressing them if they aren't cached
+static int file_data(int index, uint8_t **data, uint32_t *size) {
+    file_entry_t *e = entry(index);
+    if (compressed && !e->is_dir && e->size > 0) {
+        uint8_t *buf = copy_file(index);
+        if (!buf) return 0;
+        *data = buf;
+    } else {
+        *data = e->data;
+    }
+    *size = e->size;
+    return 1;
+}
+
+// Done with data from fs_read_file(); a no-op unless it was a copy
+void fs_release_file(const uint8_t *data) {
+    for (int i = 0; data && i < MAX_FILE_COPIES; i++) {
+        file_copy_t *c = &copies[i];
+        if (c->data != data || c->refs == 0) continue;
+        if (--c->refs > 0) return;
+        idle_copy_bytes += c->size;
+        if (c->entry == NO_ENTRY) free_copy(c);  // Its file was replaced or the initrd reset
+        while (idle_copy_bytes > TARFS_FILE_BUDGET && evict_copy());
+        return;
     }
 }
 
@@ -106,95 +739,148 @@ int fs_get_file_count(void) {
 int fs_get_file_info(int index, char *name, uint32_t *size, int *is_dir) {
     if (index < 0 || index >= file_count) return 0;
     
-    safe_strcpy(name, files[index].name, 128);
-    *size = files[index].size;
-    *is_dir = files[index].is_dir;
+    file_entry_t *e = entry(index);
+    safe_strcpy(name, e->name, MAX_NAME);
+    *size = e->size;
+    *is_dir = e->is_dir;
     return 1;
 }
 
 // Read file by name
 int fs_read_file(const char *filename, uint8_t **data, uint32_t *size) {
-    for (int i = 0; i < file_count; i++) {
-        // Simple name comparison
-        int match = 1;
-        for (int j = 0; j < 128; j++) {
-            if (files[i].name[j] != filename[j]) {
-                match = 0;
-                break;
-            }
-            if (files[i].name[j] == 0 && filename[j] == 0) break;
-        }
-        
-        if (match) {
-            *data = files[i].data;
-            *size = files[i].size;
-            return 1;
-        }
+    int len = path_len(filename, MAX_NAME);
+    int index = find_entry(filename, len);
+    
+    // Not indexed yet is not the same as not there
+    while (index == NO_ENTRY && !parse_done) {
+        parse_chunk(TARFS_CHUNK_HEADERS);
+        index = find_entry(filename, len);
     }
-    return 0;
+    if (index == NO_ENTRY) return 0;
+    return file_data(index, data, size);
+}
+
+// First entry directly inside a directory ("" or "/" for the root),
+// or -1 if it is empty or doesn't exist
+int fs_dir_first(const char *path) {
+    int len = path_len(path, MAX_NAME);
+    if (len == 0) return root_first_child;
+    
+    int dir = find_entry(path, len);
+    if (dir == NO_ENTRY || !entry(dir)->is_dir) return NO_ENTRY;
+    return entry(dir)->first_child;
+}
+
+// Next entry in the same directory as index, or -1 at the end
+int fs_dir_next(int index) {
+    if (index < 0 || index >= file_count) return NO_ENTRY;
+    return entry(index)->next_sibling;
 }
 
 // Read file by index
 int fs_read_file_by_index(int index, uint8_t **data, uint32_t *size) {
     if (index < 0 || index >= file_count) return 0;
-    
-    *data = files[index].data;
-    *size = files[index].size;
+    return file_data(index, data, size);
+}
+
+// Check an OCZ1 header and switch reads over to the block cache
+static int open_compressed(uint8_t *addr, uint32_t size) {
+    uint32_t bs = read_le32(addr + 4);
+    uint32_t raw = read_le32(addr + 8);
+    uint32_t count = read_le32(addr + 12);
+    if (bs == 0 || bs % TAR_BLOCK_SIZE || bs > ((uint32_t)PAGE_SIZE << MAX_ORDER)) return 0;
+    if (count != raw / bs + (raw % bs != 0)) return 0;
+    if (((uint64_t)count + 1) * 4 > size - OCZ_HEADER_SIZE) return 0;
+
+    int order = 0;
+    while (((uint32_t)PAGE_SIZE << order) < bs) order++;
+    int slots = (TARFS_CACHE_PAGES >> order) > 0 ? TARFS_CACHE_PAGES >> order : 1;
+    if (slots > MAX_CACHED_BLOCKS) slots = MAX_CACHED_BLOCKS;
+
+    compressed = 1;
+    image_start = addr;
+    image_size = size;
+    block_size = bs;
+    block_count = count;
+    block_order = order;
+    cache_slots = slots;
+    initrd_size = raw;
     return 1;
 }
 
 // Set initrd location (called from kernel with multiboot info)
 void fs_set_initrd(uint8_t *addr, uint32_t size) {
+    reset_index();
+    drop_cache();
+    compressed = 0;
     initrd_start = addr;
     initrd_size = size;
+    if (addr && size >= OCZ_HEADER_SIZE && read_le32(addr) == OCZ_MAGIC &&
+        !open_compressed(addr, size)) {
+        puts("[tarfs] Bad compressed initrd header\n");
+        initrd_start = NULL;
+        initrd_size = 0;
+    }
+    parse_offset = 0;
+    long_name_len = 0;
+    has_pax_size = 0;
+    parse_done = !(initrd_start && initrd_size > 0);
     
-    if (initrd_start && initrd_size > 0) {
-        parse_tar(initrd_start, initrd_size);
-        
+    if (!parse_done) {
         puts("[tarfs] Initrd loaded at ");
         char buf[32];
-        itoa_u((uint64_t)initrd_start, buf);
+        itoa_u((uintptr_t)initrd_start, buf);
         puts(buf);
         puts(", size: ");
         itoa_u(initrd_size, buf);
         puts(buf);
-        puts(" bytes\n");
+        puts(" bytes");
+        if (compressed) {
+            puts(" (");
+            itoa_u(image_size, buf);
+            puts(buf);
+            puts(" compressed)");
+        }
+        puts(", indexing\n");
+        kernel_raise_event(EVENT_TARFS);
     }
 }
 
+static void tarfs_tick(void) {
+    if (parse_chunk(TARFS_CHUNK_HEADERS)) kernel_raise_event(EVENT_TARFS);
+}
+
 static void tarfs_init(void) {
     puts("[tarfs] TAR filesystem driver initialized\n");
     
-    // For now, create a fake initrd with some test files
-    // In a real implementation, this would come from multiboot
-    
-    // Create a simple test "filesystem" in memory
-    puts("[tarfs] Creating test filesystem...\n");
-    
-    // We'll add real initrd loading later
-    // For now, just create some fake file entries
-    
-    safe_strcpy(files[0].name, "readme.txt", 128);
-    files[0].size = 50;
-    files[0].data = (uint8_t*)"Welcome to OpenComp!\nThis is a test file.\n";
-    files[0].is_dir = 0;
-    
-    safe_strcpy(files[1].name, "hello.txt", 128);
-    files[1].size = 30;
-    files[1].data = (uint8_t*)"Hello from the filesystem!";
-    files[1].is_dir = 0;
+    // The first multiboot2 module is the initrd; entries point straight
+    // into the module image, nothing is copied
+    const struct boot_module *initrd = multiboot_get_module(0);
+    if (initrd) {
+        fs_set_initrd((uint8_t *)initrd->start, initrd->end - initrd->start);
+        return;
+    }
     
-    safe_strcpy(files[2].name, "docs/", 128);
-    files[2].size = 0;
-    files[2].data = NULL;
-    files[2].is_dir = 1;
+    // No initrd: fall back to a small built-in test filesystem
+    puts("[tarfs] No initrd module, creating test filesystem...\n");
     
-    safe_strcpy(files[3].name, "docs/info.txt", 128);
-    files[3].size = 35;
-    files[3].data = (uint8_t*)"Documentation goes here.\nMore info!";
-    files[3].is_dir = 0;
+    static const struct {
+        const char *name;
+        const char *text;
+    } test_files[] = {
+        { "readme.txt", "Welcome to OpenComp!\nThis is a test file.\n" },
+        { "hello.txt", "Hello from the filesystem!" },
+        { "docs/info.txt", "Documentation goes here.\nMore info!" },
+    };
     
-    file_count = 4;
+    reset_index();
+    for (size_t i = 0; i < sizeof(test_files) / sizeof(test_files[0]); i++) {
+        const char *name = test_files[i].name;
+        int name_len = 0, text_len = 0;
+        while (name[name_len]) name_len++;
+        while (test_files[i].text[text_len]) text_len++;
+        add_entry(name, name_len, (uint8_t *)test_files[i].text, text_len, 0);
+    }
     
     puts("[tarfs] Test filesystem created with ");
     char buf[32];
@@ -203,14 +889,12 @@ static void tarfs_init(void) {
     puts(" files\n");
 }
 
-static void tarfs_tick(void) {
-    // Nothing to do
-}
-
 __attribute__((section(".compobjs"))) static struct component tarfs_component = {
     .name = "tarfs",
     .init = tarfs_init,
-    .tick = tarfs_tick
+    .tick = tarfs_tick,
+    .wake_events = EVENT_TARFS,
+    .deps = (const char *const[]){ "memory", NULL }
 };
 
 __attribute__((section(".comps"))) struct component *p_tarfs_component = &tarfs_component;
@@ -0,0 +1,72 @@
+/* timer.c
+ *
+ * PIT (8253/8254) system timer component
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * Channel 0 runs at TIMER_HZ and keeps a monotonic millisecond clock.
+ * The scheduler in kernel.c arms a deadline; the IRQ only raises
+ * EVENT_TIMER once that deadline has passed, so an idle kernel stays in
+ * hlt instead of spinning through the component list every tick.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define PIT_CHANNEL0 0x40
+#define PIT_COMMAND 0x43
+#define PIT_BASE_FREQUENCY 1193182
+#define TIMER_IRQ 0
+
+static volatile uint64_t timer_ms = 0;
+static volatile uint64_t timer_deadline = UINT64_MAX;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static void timer_irq_handler(void) {
+    uint64_t now = timer_ms + 1000 / TIMER_HZ;
+    timer_ms = now;
+    if (now >= timer_deadline) {
+        timer_deadline = UINT64_MAX;
+        kernel_raise_event(EVENT_TIMER);
+    }
+}
+
+uint64_t timer_get_ms(void) {
+    // 64-bit reads aren't atomic on i386, keep the IRQ out
+    uint32_t flags = irq_save();
+    uint64_t now = timer_ms;
+    irq_restore(flags);
+    return now;
+}
+
+void timer_set_deadline(uint64_t ms) {
+    uint32_t flags = irq_save();
+    timer_deadline = ms;
+    irq_restore(flags);
+}
+
+static void timer_init(void) {
+    uint32_t divisor = PIT_BASE_FREQUENCY / TIMER_HZ;
+
+    outb(PIT_COMMAND, 0x34);  // Channel 0, lo/hi byte, mode 2 (rate generator)
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+    irq_install_handler(TIMER_IRQ, timer_irq_handler);
+
+    puts("[timer] PIT running at ");
+    char buf[32];
+    itoa_u(TIMER_HZ, buf);
+    puts(buf);
+    puts(" Hz\n");
+}
+
+__attribute__((section(".compobjs"))) static struct component timer_component = {
+    .name = "timer",
+    .init = timer_init,
+    .tick = NULL
+};
+
+__attribute__((section(".comps"))) struct component *p_timer_component = &timer_component;
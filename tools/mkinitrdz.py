@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# mkinitrdz.py
+#
+# Pack a tar archive into OpenComp's compressed initrd container
+# Copyright (C) 2025 B."Nova" J.
+# Licensed under GNU GPLv2
+#
+# Usage: mkinitrdz.py [--block-size N] initrd.tar initrd.ocz
+#
+# Writes the OCZ1 layout described at the top of tarfs.c: a header, a
+# table of block offsets, then the tar cut into fixed-size blocks that
+# are each compressed as an LZ4 raw block (or stored as is when that is
+# no smaller). Blocks are independent, so tarfs can decompress any one
+# of them without touching the rest. Pure Python, no lz4 module needed.
+
+import struct
+import sys
+
+MAGIC = b"OCZ1"
+TAR_BLOCK_SIZE = 512
+DEFAULT_BLOCK_SIZE = 64 * 1024
+
+MIN_MATCH = 4
+LAST_LITERALS = 5      # The LZ4 format ends every block with literals
+MATCH_LIMIT = 12       # No match may start in the last 12 bytes
+MAX_OFFSET = 65535
+HASH_BITS = 16
+
+
+def hash4(data, i):
+    v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (data[i + 3] << 24)
+    return ((v * 2654435761) & 0xFFFFFFFF) >> (32 - HASH_BITS)
+
+
+def put_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def emit(out, literals, match_len, offset):
+    lit = len(literals)
+    token = (min(lit, 15) << 4)
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        put_length(out, lit - 15)
+    out += literals
+    if match_len:
+        out += struct.pack("<H", offset)
+        if match_len - MIN_MATCH >= 15:
+            put_length(out, match_len - MIN_MATCH - 15)
+
+
+def lz4_compress(data):
+    """Greedy LZ4 raw block compression with a single hash table"""
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    limit = n - MATCH_LIMIT
+
+    while i < limit:
+        h = hash4(data, i)
+        cand = table.get(h)
+        table[h] = i
+        if cand is None or i - cand > MAX_OFFSET or data[cand:cand + 4] != data[i:i + 4]:
+            i += 1
+            continue
+
+        # Extend forwards, stopping short of the final literals
+        length = MIN_MATCH
+        end = n - LAST_LITERALS
+        while i + length < end and data[cand + length] == data[i + length]:
+            length += 1
+
+        emit(out, data[anchor:i], length, i - cand)
+        i += length
+        anchor = i
+
+    emit(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(src, size):
+    """Reference decoder, used to check every block before it is written"""
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i >= len(src):
+            break
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        length = (token & 15) + MIN_MATCH
+        if token & 15 == 15:
+            while True:
+                b = src[i]
+                i += 1
+                length += b
+                if b != 255:
+                    break
+        for _ in range(length):
+            out.append(out[-offset])
+    if len(out) != size:
+        raise ValueError("decoded %d bytes, expected %d" % (len(out), size))
+    return bytes(out)
+
+
+def pack(tar, block_size):
+    blocks = []
+    for start in range(0, len(tar), block_size):
+        raw = tar[start:start + block_size]
+        packed = lz4_compress(raw)
+        if len(packed) >= len(raw):
+            packed = raw       # Stored: tarfs spots this by the length
+        elif lz4_decompress(packed, len(raw)) != raw:
+            raise ValueError("block at %d does not round-trip" % start)
+        blocks.append(packed)
+
+    header_size = 16 + 4 * (len(blocks) + 1)
+    offsets = [header_size]
+    for b in blocks:
+        offsets.append(offsets[-1] + len(b))
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<III", block_size, len(tar), len(blocks))
+    out += struct.pack("<%dI" % len(offsets), *offsets)
+    for b in blocks:
+        out += b
+    return bytes(out)
+
+
+def main(argv):
+    block_size = DEFAULT_BLOCK_SIZE
+    args = []
+    i = 1
+    while i < len(argv):
+        if argv[i] == "--block-size" and i + 1 < len(argv):
+            block_size = int(argv[i + 1], 0)
+            i += 2
+        else:
+            args.append(argv[i])
+            i += 1
+
+    if len(args) != 2 or block_size <= 0 or block_size % TAR_BLOCK_SIZE:
+        sys.stderr.write("usage: mkinitrdz.py [--block-size N] initrd.tar initrd.ocz\n"
+                         "       (N must be a multiple of 512)\n")
+        return 2
+
+    with open(args[0], "rb") as f:
+        tar = f.read()
+    out = pack(tar, block_size)
+    with open(args[1], "wb") as f:
+        f.write(out)
+
+    sys.stderr.write("mkinitrdz: %d -> %d bytes, %d blocks of %d KB\n"
+                     % (len(tar), len(out), (len(tar) + block_size - 1) // block_size,
+                        block_size // 1024))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
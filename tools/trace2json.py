@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+# trace2json.py
+#
+# Convert an OpenComp COM1 trace capture into Chrome trace JSON
+# Copyright (C) 2025 B."Nova" J.
+# Licensed under GNU GPLv2
+#
+# Usage: trace2json.py serial.log [trace.json]
+#
+# Reads the line format written by trace.c (see the comment at the top
+# of that file), ignores anything else on the port, and writes a
+# timeline with one track per component. TSC values are converted to
+# microseconds using the C clock sync lines; pass --mhz to override.
+
+import json
+import sys
+
+TRACE_SOURCE_KERNEL = 0xFFFF
+TRACE_SOURCE_IRQ = 0xFFFE
+
+TRACE_INIT_BEGIN = 1
+TRACE_INIT_END = 2
+TRACE_TICK_BEGIN = 3
+TRACE_TICK_END = 4
+TRACE_IRQ = 5
+TRACE_BOOT = 6
+TRACE_USER = 0x100
+
+BOOT_STAGES = {0: "serial up", 1: "interrupts up", 2: "components up",
+               3: "deferred inits done"}
+
+
+def parse(lines):
+    names = {TRACE_SOURCE_KERNEL: "kernel", TRACE_SOURCE_IRQ: "irq"}
+    syncs = []
+    records = []
+    dropped = 0
+
+    for raw in lines:
+        parts = raw.strip().split(" ")
+        try:
+            if parts[0] == "N" and len(parts) == 3:
+                names[int(parts[1], 16)] = parts[2]
+            elif parts[0] == "C" and len(parts) == 3:
+                syncs.append((int(parts[1], 16), int(parts[2], 16)))
+            elif parts[0] == "T" and len(parts) == 5:
+                records.append(tuple(int(p, 16) for p in parts[1:]))
+            elif parts[0] == "D" and len(parts) == 2:
+                dropped += int(parts[1], 16)
+        except ValueError:
+            continue  # Line mangled by other output on the port
+
+    return names, syncs, records, dropped
+
+
+def cycles_per_us(syncs):
+    if len(syncs) >= 2:
+        (ms0, tsc0), (ms1, tsc1) = syncs[0], syncs[-1]
+        if ms1 > ms0:
+            return (tsc1 - tsc0) / ((ms1 - ms0) * 1000.0)
+    return None
+
+
+def to_chrome(names, records, cpu_us):
+    base = min(r[0] for r in records) if records else 0
+    events = []
+
+    for source, name in names.items():
+        events.append({"name": "thread_name", "ph": "M", "pid": 0,
+                       "tid": source, "args": {"name": name}})
+
+    for tsc, source, event, arg in sorted(records):
+        ev = {"pid": 0, "tid": source, "ts": (tsc - base) / cpu_us}
+        if event in (TRACE_INIT_BEGIN, TRACE_TICK_BEGIN):
+            ev.update(ph="B", name="init" if event == TRACE_INIT_BEGIN else "tick")
+        elif event in (TRACE_INIT_END, TRACE_TICK_END):
+            ev.update(ph="E", name="init" if event == TRACE_INIT_END else "tick")
+        elif event == TRACE_IRQ:
+            ev.update(ph="i", s="t", name="IRQ%d" % arg)
+        elif event == TRACE_BOOT:
+            ev.update(ph="i", s="g", name=BOOT_STAGES.get(arg, "boot %d" % arg))
+        else:
+            label = "user+%d" % (event - TRACE_USER) if event >= TRACE_USER else "event %d" % event
+            ev.update(ph="i", s="t", name=label, args={"arg": arg})
+        events.append(ev)
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main(argv):
+    mhz = None
+    args = []
+    i = 1
+    while i < len(argv):
+        if argv[i] == "--mhz" and i + 1 < len(argv):
+            mhz = float(argv[i + 1])
+            i += 2
+        else:
+            args.append(argv[i])
+            i += 1
+
+    if not args:
+        sys.stderr.write("usage: trace2json.py [--mhz N] serial.log [trace.json]\n")
+        return 2
+
+    with open(args[0], "r", errors="replace") as f:
+        names, syncs, records, dropped = parse(f)
+
+    cpu_us = mhz or cycles_per_us(syncs)
+    if not cpu_us:
+        sys.stderr.write("trace2json: no clock sync in capture, assuming 1000 MHz (use --mhz)\n")
+        cpu_us = 1000.0
+
+    out = json.dumps(to_chrome(names, records, cpu_us))
+    if len(args) > 1:
+        with open(args[1], "w") as f:
+            f.write(out)
+    else:
+        sys.stdout.write(out)
+
+    sys.stderr.write("trace2json: %d records, %d dropped, %.0f MHz TSC\n"
+                     % (len(records), dropped, cpu_us))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,195 @@
+/* trace.c
+ *
+ * Binary trace ring with a COM1 export for OpenComp
+ * Copyright (C) 2025 B."Nova" J.
+ * Licensed under GNU GPLv2
+ *
+ * trace_event() stamps a fixed-size record with the TSC and drops it in
+ * a power-of-two ring. Writers reserve a slot with one atomic add and
+ * publish it by storing the slot's sequence number last, so IRQ handlers
+ * and components can trace without locks or disabling interrupts. When
+ * the ring wraps, the oldest records are overwritten and the reader
+ * reports how many it missed.
+ *
+ * The kernel calls trace_drain() when it is about to go idle. It turns
+ * records into short hex text lines and feeds them to the UART only
+ * while the FIFO has room, so draining never stalls a wakeup:
+ *
+ *   N <source> <name>              component name for a source id
+ *   C <ms> <tsc>                   clock sync, PIT milliseconds vs TSC
+ *   T <tsc> <source> <event> <arg> one trace record
+ *   D <count>                      records lost to overwrites
+ *
+ * tools/trace2json.py turns a capture into a Chrome trace timeline.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+#define TRACE_RING_SIZE 1024  // Records; must be a power of two
+#define TRACE_SYNC_MS 1000    // How often to emit a clock sync line
+
+struct trace_record {
+    uint64_t tsc;
+    uint16_t source;
+    uint16_t event;
+    uint32_t arg;
+    uint32_t seq;             // Slot number + 1 once the record is complete
+    uint32_t reserved;
+};
+
+static struct trace_record ring[TRACE_RING_SIZE];
+static uint32_t trace_head = 0;             // Next slot to reserve
+static uint32_t trace_tail = 0;             // Next slot the reader wants
+static volatile uint16_t current_source = TRACE_SOURCE_KERNEL;
+
+// Reader state; only trace_drain() touches these
+static char line[64];
+static int line_len = 0;
+static int line_pos = 0;
+static int names_sent = 0;
+static uint32_t dropped = 0;
+static uint64_t last_sync_ms = 0;
+static int synced = 0;
+
+void trace_event(uint16_t source, uint16_t event, uint32_t arg) {
+    uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+    struct trace_record *r = &ring[slot & (TRACE_RING_SIZE - 1)];
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->tsc = rdtsc();
+    r->source = source;
+    r->event = event;
+    r->arg = arg;
+    __atomic_store_n(&r->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+void trace_mark(uint16_t event, uint32_t arg) {
+    trace_event(current_source, event, arg);
+}
+
+void trace_set_source(uint16_t source) {
+    current_source = source;
+}
+
+static void line_hex(uint64_t v, int min_digits) {
+    char tmp[16];
+    int n = 0;
+    do {
+        tmp[n++] = "0123456789abcdef"[v & 0xF];
+        v >>= 4;
+    } while (v || n < min_digits);
+    while (n > 0) line[line_len++] = tmp[--n];
+}
+
+static void line_char(char c) {
+    line[line_len++] = c;
+}
+
+static void line_str(const char *s, int max) {
+    for (int i = 0; s[i] && i < max; i++) {
+        // Names end at the first space as far as the decoder is concerned
+        line[line_len++] = s[i] == ' ' ? '_' : s[i];
+    }
+}
+
+static void line_begin(char kind) {
+    line_len = 0;
+    line_pos = 0;
+    line_char(kind);
+    line_char(' ');
+}
+
+// Pull the next complete record off the ring into line[]; 0 when empty
+static int format_next_record(void) {
+    for (;;) {
+        uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+        if (trace_tail == head) return 0;
+
+        // The writers lapped us, skip to the oldest record still there
+        if (head - trace_tail > TRACE_RING_SIZE) {
+            dropped += head - trace_tail - TRACE_RING_SIZE;
+            trace_tail = head - TRACE_RING_SIZE;
+        }
+
+        struct trace_record *r = &ring[trace_tail & (TRACE_RING_SIZE - 1)];
+        uint32_t want = trace_tail + 1;
+        uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (seq != want) {
+            // Zero or an older lap means the writer is mid-record, try later
+            if (seq == 0 || (int32_t)(seq - want) < 0) return 0;
+            dropped++;
+            trace_tail++;
+            continue;
+        }
+
+        struct trace_record copy = *r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != want) {
+            dropped++;  // Overwritten while we copied it
+            trace_tail++;
+            continue;
+        }
+        trace_tail++;
+
+        line_begin('T');
+        line_hex(copy.tsc, 1);
+        line_char(' ');
+        line_hex(copy.source, 1);
+        line_char(' ');
+        line_hex(copy.event, 1);
+        line_char(' ');
+        line_hex(copy.arg, 1);
+        line_char('\n');
+        return 1;
+    }
+}
+
+// Decide what the next line on the wire is; 0 when there is nothing to send
+static int format_next_line(void) {
+    if (names_sent < kernel_component_count()) {
+        const struct component *c = kernel_get_component(names_sent);
+        line_begin('N');
+        line_hex(names_sent, 1);
+        line_char(' ');
+        line_str(c && c->name ? c->name : "?", 32);
+        line_char('\n');
+        names_sent++;
+        return 1;
+    }
+
+    uint64_t now = timer_get_ms();
+    if (!synced || now - last_sync_ms >= TRACE_SYNC_MS) {
+        synced = 1;
+        last_sync_ms = now;
+        line_begin('C');
+        line_hex(now, 1);
+        line_char(' ');
+        line_hex(rdtsc(), 1);
+        line_char('\n');
+        return 1;
+    }
+
+    if (dropped) {
+        line_begin('D');
+        line_hex(dropped, 1);
+        line_char('\n');
+        dropped = 0;
+        return 1;
+    }
+
+    return format_next_record();
+}
+
+void trace_drain(void) {
+    if (!serial_available()) return;
+
+    for (;;) {
+        if (line_pos == line_len && !format_next_line()) return;
+        while (line_pos < line_len) {
+            if (!serial_try_putc(line[line_pos])) return;  // FIFO full, resume next idle
+            line_pos++;
+        }
+    }
+}
@@ -1,8 +1,25 @@
 /* vga_graphics.c
  *
- * VGA Mode 13h graphics driver (320x200, 256 colors)
+ * Graphics driver: linear framebuffer or VGA Mode 13h
  * Copyright (C) 2025 B."Nova" J.
  * Licensed under GNU GPLv2
+ *
+ * All drawing goes to a back buffer in ordinary RAM. Primitives record
+ * the area they touched in a small dirty-rectangle list, and
+ * vga_flush() copies only those areas to video memory with rep movsd,
+ * optionally waiting for vertical retrace first to avoid tearing.
+ *
+ * If GRUB handed us a 32bpp linear framebuffer (start.S asks for one)
+ * we draw at its native resolution: the back buffer holds pixels in the
+ * framebuffer's own format, so fills are one dword store per pixel and
+ * flushes are straight row copies honouring the framebuffer pitch.
+ * Colors stay 8-bit palette indices in the API and are looked up in
+ * palette32[] on the way in. Otherwise we program mode 13h (320x200,
+ * 256 colors) by hand and the back buffer is 8 bits per pixel.
+ *
+ * Big fills and flushes are cut into horizontal bands and spread over
+ * the CPUs with smp_parallel(). Bands never share a row, and the band
+ * workers touch nothing but pixels, so they need no locking.
  */
 
 #include <stdint.h>
@@ -11,8 +28,42 @@
 #define VGA_WIDTH 320
 #define VGA_HEIGHT 200
 #define VGA_MEMORY 0xA0000
+#define MAX_LFB_ORDER MAX_ORDER  // Back buffer must fit one buddy block
+#define VGA_LINE_HEIGHT 10  // 8-pixel glyphs plus 2 pixels of leading
+
+#define MAX_DIRTY_RECTS 16
+#define PARALLEL_MIN_PIXELS 65536  // Smaller jobs aren't worth waking the APs for
+
+#ifdef OPENCOMP_HOSTED
+// Userspace build (make host): the harness provides VGA memory
+extern uint8_t host_vram[];
+static uint8_t *vram = host_vram;
+#else
+static uint8_t *vram = (uint8_t *)VGA_MEMORY;
+#endif
+static uint8_t framebuffer[VGA_WIDTH * VGA_HEIGHT] __attribute__((aligned(16)));
 
-static uint8_t *framebuffer = (uint8_t *)VGA_MEMORY;
+// Active mode; starts out as mode 13h drawing into framebuffer[]
+static int screen_width = VGA_WIDTH;
+static int screen_height = VGA_HEIGHT;
+static int bytes_per_pixel = 1;
+static uint8_t *back = framebuffer;
+static size_t back_pitch = VGA_WIDTH;   // Bytes per back buffer row
+static size_t front_pitch = VGA_WIDTH;  // Bytes per video memory row
+
+// 32bpp value for each palette index, in the framebuffer's channel order
+static uint32_t palette32[256];
+
+typedef struct {
+    int x0, y0, x1, y1;  // Half-open: [x0, x1) x [y0, y1)
+} dirty_rect_t;
+
+static dirty_rect_t dirty_rects[MAX_DIRTY_RECTS];
+static int dirty_count = 0;
+static int vsync_enabled = 1;
+
+// Every primitive is clipped to this rect (half-open, like dirty_rect_t)
+static dirty_rect_t clip = { 0, 0, VGA_WIDTH, VGA_HEIGHT };
 
 // VGA registers
 #define VGA_MISC_WRITE 0x3C2
@@ -22,7 +73,16 @@ static uint8_t *framebuffer = (uint8_t *)VGA_MEMORY;
 #define VGA_CRTC_DATA 0x3D5
 #define VGA_GC_INDEX 0x3CE
 #define VGA_GC_DATA 0x3CF
+#define VGA_INPUT_STATUS 0x3DA
+#define VGA_RETRACE 0x08
 
+#ifdef OPENCOMP_HOSTED
+// ...and fakes the ports, see host/hosted.c
+void host_outb(uint16_t port, uint8_t val);
+uint8_t host_inb(uint16_t port);
+#define outb host_outb
+#define inb host_inb
+#else
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
 }
@@ -32,6 +92,7 @@ static inline uint8_t inb(uint16_t port) {
     __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
     return ret;
 }
+#endif
 
 // Set VGA Mode 13h (320x200, 256 colors)
 static void set_mode_13h(void) {
@@ -69,41 +130,406 @@ static void set_mode_13h(void) {
     outb(VGA_GC_INDEX, 0x06); outb(VGA_GC_DATA, 0x05);
 }
 
+static int rect_area(const dirty_rect_t *r) {
+    return (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void rect_union(dirty_rect_t *dst, const dirty_rect_t *src) {
+    if (src->x0 < dst->x0) dst->x0 = src->x0;
+    if (src->y0 < dst->y0) dst->y0 = src->y0;
+    if (src->x1 > dst->x1) dst->x1 = src->x1;
+    if (src->y1 > dst->y1) dst->y1 = src->y1;
+}
+
+// Record an area of the back buffer that must reach video memory
+void vga_mark_dirty(int x, int y, int w, int h) {
+    dirty_rect_t r = { x, y, x + w, y + h };
+    if (r.x0 < clip.x0) r.x0 = clip.x0;
+    if (r.y0 < clip.y0) r.y0 = clip.y0;
+    if (r.x1 > clip.x1) r.x1 = clip.x1;
+    if (r.y1 > clip.y1) r.y1 = clip.y1;
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return;
+
+    // Absorb any rect that overlaps or touches the new one; repeat
+    // because the grown rect can now reach others in the list
+    int merged = 1;
+    while (merged) {
+        merged = 0;
+        for (int i = 0; i < dirty_count; i++) {
+            dirty_rect_t *d = &dirty_rects[i];
+            if (d->x0 <= r.x1 && r.x0 <= d->x1 && d->y0 <= r.y1 && r.y0 <= d->y1) {
+                rect_union(&r, d);
+                dirty_rects[i] = dirty_rects[--dirty_count];
+                merged = 1;
+                break;
+            }
+        }
+    }
+
+    if (dirty_count < MAX_DIRTY_RECTS) {
+        dirty_rects[dirty_count++] = r;
+        return;
+    }
+
+    // List full: fold into whichever rect grows the least
+    int best = 0;
+    int best_growth = 0x7FFFFFFF;
+    for (int i = 0; i < dirty_count; i++) {
+        dirty_rect_t u = dirty_rects[i];
+        rect_union(&u, &r);
+        int growth = rect_area(&u) - rect_area(&dirty_rects[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    rect_union(&dirty_rects[best], &r);
+}
+
+// Restrict all drawing to a rectangle (intersected with the screen)
+void vga_set_clip(int x, int y, int w, int h) {
+    clip.x0 = x < 0 ? 0 : x;
+    clip.y0 = y < 0 ? 0 : y;
+    clip.x1 = x + w > screen_width ? screen_width : x + w;
+    clip.y1 = y + h > screen_height ? screen_height : y + h;
+}
+
+void vga_reset_clip(void) {
+    clip.x0 = 0;
+    clip.y0 = 0;
+    clip.x1 = screen_width;
+    clip.y1 = screen_height;
+}
+
+int vga_get_width(void) {
+    return screen_width;
+}
+
+int vga_get_height(void) {
+    return screen_height;
+}
+
+int vga_get_depth(void) {
+    return bytes_per_pixel * 8;
+}
+
+void vga_set_vsync(int enabled) {
+    vsync_enabled = enabled;
+}
+
+// Will vga_flush() wait for retrace? Only mode 13h has a retrace bit to poll
+int vga_vsync_available(void) {
+    return vsync_enabled && bytes_per_pixel == 1;
+}
+
+// Cycles the last vga_flush() spent waiting for retrace, so callers
+// timing a flush can leave the wait out
+static uint64_t last_vsync_wait = 0;
+
+uint64_t vga_last_vsync_wait(void) {
+    return last_vsync_wait;
+}
+
+// Wait for the start of the next vertical retrace
+static void wait_vretrace(void) {
+    while (inb(VGA_INPUT_STATUS) & VGA_RETRACE);
+    while (!(inb(VGA_INPUT_STATUS) & VGA_RETRACE));
+}
+
+// The area copy_to_vram() really writes for r: 8bpp rows are widened
+// to dword boundaries so every row is a single rep movsd; 32bpp pixels
+// already are dwords
+static dirty_rect_t copied_rect(const dirty_rect_t *r) {
+    dirty_rect_t c = *r;
+    if (bytes_per_pixel == 1) {
+        c.x0 &= ~3;
+        c.x1 = (c.x1 + 3) & ~3;
+    }
+    return c;
+}
+
+// Copy one area of the back buffer to video memory
+static void copy_to_vram(const dirty_rect_t *r) {
+    dirty_rect_t c = copied_rect(r);
+    int x0 = c.x0;
+    size_t dwords = (size_t)(c.x1 - x0) * bytes_per_pixel / 4;
+
+    for (int y = r->y0; y < r->y1; y++) {
+        const uint8_t *src = back + y * back_pitch + x0 * bytes_per_pixel;
+        uint8_t *dst = vram + y * front_pitch + x0 * bytes_per_pixel;
+        size_t count = dwords;
+        __asm__ volatile("rep movsl"
+                         : "+S"(src), "+D"(dst), "+c"(count)
+                         : : "memory");
+    }
+}
+
+/* ------------------------------
+   Mouse cursor
+   ------------------------------
+
+   The pointer is a sprite drawn straight into video memory, never into
+   the back buffer. The back buffer therefore always holds exactly what
+   is under the pointer and doubles as its save-under: moving the cursor
+   copies the old CURSOR_W x CURSOR_H area back from it and paints the
+   sprite at the new spot, so motion costs O(cursor area) no matter what
+   is on screen. vga_flush() repaints the sprite when a dirty rect it
+   just copied overlapped it.
+
+   Neither the VGA nor the Bochs/QEMU VBE adapter has cursor registers,
+   so this software sprite is the only implementation for now.
+*/
+
+#define CURSOR_W 11
+#define CURSOR_H 16
+
+// 'X' outline, '.' fill, ' ' transparent; hotspot is the top-left pixel
+static const char *cursor_shape[CURSOR_H] = {
+    "X          ",
+    "XX         ",
+    "X.X        ",
+    "X..X       ",
+    "X...X      ",
+    "X....X     ",
+    "X.....X    ",
+    "X......X   ",
+    "X.......X  ",
+    "X........X ",
+    "X.....XXXXX",
+    "X..X..X    ",
+    "X.X X..X   ",
+    "XX  X..X   ",
+    "X    X..X  ",
+    "     XXXX  "
+};
+
+#define CURSOR_OUTLINE 0x00  // Black
+#define CURSOR_FILL 0x0F     // White
+
+static int cursor_visible = 0;
+static int cursor_x = 0;
+static int cursor_y = 0;
+
+// The on-screen area the sprite covers, clipped to the screen
+static dirty_rect_t cursor_rect(void) {
+    dirty_rect_t r = { cursor_x, cursor_y, cursor_x + CURSOR_W, cursor_y + CURSOR_H };
+    if (r.x0 < 0) r.x0 = 0;
+    if (r.y0 < 0) r.y0 = 0;
+    if (r.x1 > screen_width) r.x1 = screen_width;
+    if (r.y1 > screen_height) r.y1 = screen_height;
+    return r;
+}
+
+static int rects_overlap(const dirty_rect_t *a, const dirty_rect_t *b) {
+    return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static void paint_cursor(void) {
+    dirty_rect_t r = cursor_rect();
+    for (int y = r.y0; y < r.y1; y++) {
+        const char *row = cursor_shape[y - cursor_y];
+        uint8_t *dst = vram + y * front_pitch;
+        for (int x = r.x0; x < r.x1; x++) {
+            char c = row[x - cursor_x];
+            if (c == ' ') continue;
+            uint8_t color = c == 'X' ? CURSOR_OUTLINE : CURSOR_FILL;
+            if (bytes_per_pixel == 4) ((uint32_t *)dst)[x] = palette32[color];
+            else dst[x] = color;
+        }
+    }
+}
+
+// Put back what the sprite covered
+static void erase_cursor(void) {
+    dirty_rect_t r = cursor_rect();
+    if (r.x0 < r.x1 && r.y0 < r.y1) copy_to_vram(&r);
+}
+
+void vga_cursor_show(int visible) {
+    if (visible == cursor_visible) return;
+    cursor_visible = visible;
+    if (visible) paint_cursor();
+    else erase_cursor();
+}
+
+void vga_cursor_move(int x, int y) {
+    if (x == cursor_x && y == cursor_y) return;
+    if (cursor_visible) erase_cursor();
+    cursor_x = x;
+    cursor_y = y;
+    if (cursor_visible) paint_cursor();
+}
+
+// Split rows [y0, y1) into parts bands and return band 'part' of them
+static void band_rows(int y0, int y1, int part, int parts, int *b0, int *b1) {
+    int h = y1 - y0;
+    *b0 = y0 + h * part / parts;
+    *b1 = y0 + h * (part + 1) / parts;
+}
+
+// How many bands to cut a job of this many pixels into
+static int band_count(int pixels) {
+    return pixels >= PARALLEL_MIN_PIXELS ? smp_cpu_count() : 1;
+}
+
+// One band of every dirty rect; arg points at the band count
+static void flush_band(void *arg, int part) {
+    int parts = *(const int *)arg;
+    for (int i = 0; i < dirty_count; i++) {
+        dirty_rect_t band = dirty_rects[i];
+        band_rows(dirty_rects[i].y0, dirty_rects[i].y1, part, parts, &band.y0, &band.y1);
+        if (band.y0 < band.y1) copy_to_vram(&band);
+    }
+}
+
+// Copy dirty areas of the back buffer to video memory
+void vga_flush(void) {
+    last_vsync_wait = 0;  // Also for a flush with nothing to do
+    if (dirty_count == 0) return;
+    // The retrace bit lives in a VGA register; VBE framebuffers needn't have it
+    if (vga_vsync_available()) {
+        uint64_t start = rdtsc();
+        wait_vretrace();
+        last_vsync_wait = rdtsc() - start;
+    }
+
+    dirty_rect_t under = cursor_rect();
+    int repaint = 0;
+    int pixels = 0;
+    for (int i = 0; i < dirty_count; i++) {
+        pixels += rect_area(&dirty_rects[i]);
+        // Test what will be copied: widening can reach under the sprite
+        dirty_rect_t copied = copied_rect(&dirty_rects[i]);
+        if (cursor_visible && rects_overlap(&copied, &under)) repaint = 1;
+    }
+    int parts = band_count(pixels);
+    smp_parallel(flush_band, &parts, parts);
+    if (repaint) paint_cursor();
+    dirty_count = 0;
+}
+
+static inline uint8_t *pixel_addr(int x, int y) {
+    return back + y * back_pitch + x * bytes_per_pixel;
+}
+
+// Store one pixel, no clipping
+static inline void put_pixel(uint8_t *p, uint8_t color) {
+    if (bytes_per_pixel == 4) *(uint32_t *)p = palette32[color];
+    else *p = color;
+}
+
 // Set a pixel at (x, y) with color
 void vga_setpixel(int x, int y, uint8_t color) {
-    if (x >= 0 && x < VGA_WIDTH && y >= 0 && y < VGA_HEIGHT) {
-        framebuffer[y * VGA_WIDTH + x] = color;
+    if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1) {
+        put_pixel(pixel_addr(x, y), color);
+        vga_mark_dirty(x, y, 1, 1);
     }
 }
 
-// Clear screen with color
-void vga_clear_screen(uint8_t color) {
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-        framebuffer[i] = color;
+// Plot without dirty tracking; callers mark their bounding box once
+static void plot(int x, int y, uint8_t color) {
+    if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1) {
+        put_pixel(pixel_addr(x, y), color);
     }
 }
 
+// Fill n pixels with color. 32bpp is one rep stosl; at 8bpp it's byte
+// stores up to dword alignment, rep stosl for the body, then the tail
+static inline void fill_span(uint8_t *dst, int n, uint8_t color) {
+    if (bytes_per_pixel == 4) {
+        size_t count = (size_t)n;
+        __asm__ volatile("rep stosl"
+                         : "+D"(dst), "+c"(count)
+                         : "a"(palette32[color])
+                         : "memory");
+        return;
+    }
+    while (n > 0 && ((uintptr_t)dst & 3)) {
+        *dst++ = color;
+        n--;
+    }
+    size_t dwords = (uint32_t)n >> 2;
+    if (dwords) {
+        uint32_t pattern = color * 0x01010101u;
+        __asm__ volatile("rep stosl"
+                         : "+D"(dst), "+c"(dwords)
+                         : "a"(pattern)
+                         : "memory");
+    }
+    for (n &= 3; n > 0; n--) *dst++ = color;
+}
+
+// Intersect a rect with the clip rect; returns 0 if nothing is left
+static int clip_rect(int *x, int *y, int *w, int *h) {
+    int x0 = *x, y0 = *y, x1 = *x + *w, y1 = *y + *h;
+    if (x0 < clip.x0) x0 = clip.x0;
+    if (y0 < clip.y0) y0 = clip.y0;
+    if (x1 > clip.x1) x1 = clip.x1;
+    if (y1 > clip.y1) y1 = clip.y1;
+    if (x0 >= x1 || y0 >= y1) return 0;
+    *x = x0;
+    *y = y0;
+    *w = x1 - x0;
+    *h = y1 - y0;
+    return 1;
+}
+
+// Horizontal span [x, x + w) on row y, clipped
+static void hspan(int x, int y, int w, uint8_t color) {
+    int h = 1;
+    if (!clip_rect(&x, &y, &w, &h)) return;
+    fill_span(pixel_addr(x, y), w, color);
+}
+
+// Vertical span [y, y + h) on column x, clipped
+static void vspan(int x, int y, int h, uint8_t color) {
+    int w = 1;
+    if (!clip_rect(&x, &y, &w, &h)) return;
+    uint8_t *p = pixel_addr(x, y);
+    for (; h > 0; h--, p += back_pitch) put_pixel(p, color);
+}
+
+// Clear screen (or the current clip rect) with color
+void vga_clear_screen(uint8_t color) {
+    vga_fill_rect(0, 0, screen_width, screen_height, color);
+}
+
 // Draw a filled rectangle
-void vga_fill_rect(int x, int y, int w, int h, uint8_t color) {
-    for (int dy = 0; dy < h; dy++) {
-        for (int dx = 0; dx < w; dx++) {
-            vga_setpixel(x + dx, y + dy, color);
-        }
+typedef struct {
+    uint8_t *top;
+    int w, h;
+    uint8_t color;
+    int parts;
+} fill_job_t;
+
+static void fill_band(void *arg, int part) {
+    const fill_job_t *job = arg;
+    int y0, y1;
+    band_rows(0, job->h, part, job->parts, &y0, &y1);
+    uint8_t *row = job->top + y0 * back_pitch;
+    for (int dy = y0; dy < y1; dy++, row += back_pitch) {
+        fill_span(row, job->w, job->color);
     }
 }
 
+void vga_fill_rect(int x, int y, int w, int h, uint8_t color) {
+    // Clip once, then every row is a single span fill
+    if (!clip_rect(&x, &y, &w, &h)) return;
+    fill_job_t job = { pixel_addr(x, y), w, h, color, band_count(w * h) };
+    smp_parallel(fill_band, &job, job.parts);
+    vga_mark_dirty(x, y, w, h);
+}
+
 // Draw a rectangle outline
 void vga_draw_rect(int x, int y, int w, int h, uint8_t color) {
+    if (w <= 0 || h <= 0) return;
     // Top and bottom
-    for (int dx = 0; dx < w; dx++) {
-        vga_setpixel(x + dx, y, color);
-        vga_setpixel(x + dx, y + h - 1, color);
-    }
+    hspan(x, y, w, color);
+    hspan(x, y + h - 1, w, color);
     // Left and right
-    for (int dy = 0; dy < h; dy++) {
-        vga_setpixel(x, y + dy, color);
-        vga_setpixel(x + w - 1, y + dy, color);
-    }
+    vspan(x, y + 1, h - 2, color);
+    vspan(x + w - 1, y + 1, h - 2, color);
+    vga_mark_dirty(x, y, w, h);
 }
 
 // Draw a line (Bresenham's algorithm)
@@ -112,13 +538,24 @@ void vga_draw_line(int x0, int y0, int x1, int y1, uint8_t color) {
     int dy = y1 - y0;
     if (dx < 0) dx = -dx;
     if (dy < 0) dy = -dy;
+    vga_mark_dirty(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, dx + 1, dy + 1);
+    
+    // Axis-aligned lines are spans
+    if (dy == 0) {
+        hspan(x0 < x1 ? x0 : x1, y0, dx + 1, color);
+        return;
+    }
+    if (dx == 0) {
+        vspan(x0, y0 < y1 ? y0 : y1, dy + 1, color);
+        return;
+    }
     
     int sx = x0 < x1 ? 1 : -1;
     int sy = y0 < y1 ? 1 : -1;
     int err = (dx > dy ? dx : -dy) / 2;
     
     while (1) {
-        vga_setpixel(x0, y0, color);
+        plot(x0, y0, color);
         if (x0 == x1 && y0 == y1) break;
         
         int e2 = err;
@@ -207,51 +644,212 @@ static uint8_t font_8x8[128][8] = {
     [122] = {0x7E, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x7E, 0x00}, // z
 };
 
-// Draw a character at (x, y)
-void vga_draw_char(int x, int y, char c, uint8_t color) {
-    if (c < 0 || c >= 128) return;
-    
+// Byte masks for 4 glyph pixels: bit 3 of the nibble is the leftmost
+// pixel, which lands in the lowest-addressed byte of the dword
+static const uint32_t nibble_masks[16] = {
+    0x00000000, 0xFF000000, 0x00FF0000, 0xFFFF0000,
+    0x0000FF00, 0xFF00FF00, 0x00FFFF00, 0xFFFFFF00,
+    0x000000FF, 0xFF0000FF, 0x00FF00FF, 0xFFFF00FF,
+    0x0000FFFF, 0xFF00FFFF, 0x00FFFFFF, 0xFFFFFFFF
+};
+
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32;
+
+// Render one glyph into the back buffer without dirty tracking
+static void draw_glyph(int x, int y, char c, uint8_t color) {
+    if ((unsigned char)c >= 128) return;
+    const uint8_t *glyph = font_8x8[(int)c];
+
+    if (x >= clip.x0 && x + 8 <= clip.x1 && y >= clip.y0 && y + 8 <= clip.y1 &&
+        bytes_per_pixel == 4) {
+        // Fully visible at 32bpp: one dword store per set pixel
+        uint32_t pixel = palette32[color];
+        uint8_t *row = pixel_addr(x, y);
+        for (int r = 0; r < 8; r++, row += back_pitch) {
+            uint8_t line = glyph[r];
+            uint32_t *p = (uint32_t *)row;
+            for (int col = 0; line; col++, line <<= 1) {
+                if (line & 0x80) p[col] = pixel;
+            }
+        }
+        return;
+    }
+
+    if (x >= clip.x0 && x + 8 <= clip.x1 && y >= clip.y0 && y + 8 <= clip.y1) {
+        // Fully visible at 8bpp: each row is two masked dword stores
+        uint32_t pattern = color * 0x01010101u;
+        uint8_t *row = pixel_addr(x, y);
+        for (int r = 0; r < 8; r++, row += back_pitch) {
+            uint8_t line = glyph[r];
+            if (!line) continue;
+            unaligned_u32 *p = (unaligned_u32 *)row;
+            uint32_t m0 = nibble_masks[line >> 4];
+            uint32_t m1 = nibble_masks[line & 0x0F];
+            p[0] = (p[0] & ~m0) | (pattern & m0);
+            p[1] = (p[1] & ~m1) | (pattern & m1);
+        }
+        return;
+    }
+
+    // Partially clipped: fall back to per-pixel plotting
     for (int row = 0; row < 8; row++) {
-        uint8_t line = font_8x8[(int)c][row];
+        uint8_t line = glyph[row];
         for (int col = 0; col < 8; col++) {
             if (line & (0x80 >> col)) {
-                vga_setpixel(x + col, y + row, color);
+                plot(x + col, y + row, color);
             }
         }
     }
 }
 
+// Draw a character at (x, y)
+void vga_draw_char(int x, int y, char c, uint8_t color) {
+    draw_glyph(x, y, c, color);
+    vga_mark_dirty(x, y, 8, 8);
+}
+
 // Draw a string
 void vga_draw_string(int x, int y, const char *str, uint8_t color) {
     int cx = x;
     while (*str) {
-        vga_draw_char(cx, y, *str, color);
+        draw_glyph(cx, y, *str, color);
         cx += 8;
         str++;
     }
+    vga_mark_dirty(x, y, cx - x, 8);
+}
+
+// Draw exactly n characters, for text that isn't NUL-terminated
+void vga_draw_chars(int x, int y, const char *s, int n, uint8_t color) {
+    for (int i = 0; i < n; i++) draw_glyph(x + i * 8, y, s[i], color);
+    if (n > 0) vga_mark_dirty(x, y, n * 8, 8);
+}
+
+// Draw text inside a w x h box: wraps at the box width and on '\n',
+// and stops at the first line whose glyphs would cross the bottom edge
+void vga_draw_text_block(int x, int y, int w, int h, const char *text, uint8_t color) {
+    int max_chars = w / 8;
+    if (max_chars <= 0) return;
+
+    int col = 0;
+    int cy = y;
+    for (; *text && cy + 8 <= y + h; text++) {
+        if (*text == '\n') {
+            col = 0;
+            cy += VGA_LINE_HEIGHT;
+            continue;
+        }
+        if (col >= max_chars) {
+            col = 0;
+            cy += VGA_LINE_HEIGHT;
+            if (cy + 8 > y + h) break;
+        }
+        // Lines above or below the clip rect only advance the layout
+        if (cy + 8 > clip.y0 && cy < clip.y1) {
+            draw_glyph(x + col * 8, cy, *text, color);
+        }
+        col++;
+    }
+    vga_mark_dirty(x, y, w, h);
+}
+
+// Scale an 8-bit channel value to the framebuffer's field and position it
+static uint32_t channel(uint8_t value, uint8_t pos, uint8_t size) {
+    if (size == 0) return 0;
+    uint32_t v = size >= 8 ? value : (uint32_t)value >> (8 - size);
+    return v << pos;
+}
+
+// An approximation of the default VGA palette: the 16 EGA colors,
+// 16 grays, then a 6x6x6 color cube
+static void build_palette(const struct boot_framebuffer *fb) {
+    static const uint8_t ega[16][3] = {
+        {0x00, 0x00, 0x00}, {0x00, 0x00, 0xAA}, {0x00, 0xAA, 0x00}, {0x00, 0xAA, 0xAA},
+        {0xAA, 0x00, 0x00}, {0xAA, 0x00, 0xAA}, {0xAA, 0x55, 0x00}, {0xAA, 0xAA, 0xAA},
+        {0x55, 0x55, 0x55}, {0x55, 0x55, 0xFF}, {0x55, 0xFF, 0x55}, {0x55, 0xFF, 0xFF},
+        {0xFF, 0x55, 0x55}, {0xFF, 0x55, 0xFF}, {0xFF, 0xFF, 0x55}, {0xFF, 0xFF, 0xFF}
+    };
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t r, g, b;
+        if (i < 16) {
+            r = ega[i][0];
+            g = ega[i][1];
+            b = ega[i][2];
+        } else if (i < 32) {
+            r = g = b = (uint8_t)((i - 16) * 17);
+        } else if (i < 32 + 216) {
+            int c = i - 32;
+            r = (uint8_t)((c / 36) * 51);
+            g = (uint8_t)((c / 6 % 6) * 51);
+            b = (uint8_t)((c % 6) * 51);
+        } else {
+            r = g = b = 0;
+        }
+        palette32[i] = channel(r, fb->red_pos, fb->red_size) |
+                       channel(g, fb->green_pos, fb->green_size) |
+                       channel(b, fb->blue_pos, fb->blue_size);
+    }
+}
+
+// Switch to the bootloader's framebuffer if it is one we can draw into
+static int init_lfb(const struct boot_framebuffer *fb) {
+    if (fb->type != FRAMEBUFFER_TYPE_RGB || fb->bpp != 32) return 0;
+    if ((uintptr_t)fb->addr != fb->addr) return 0;  // Above 4 GB, out of reach
+
+    size_t pitch = (size_t)fb->width * 4;
+    size_t size = pitch * fb->height;
+    int order = 0;
+    while (order < MAX_LFB_ORDER && ((size_t)PAGE_SIZE << order) < size) order++;
+    if (((size_t)PAGE_SIZE << order) < size) return 0;
+
+    uint8_t *buffer = kalloc_pages(order);
+    if (!buffer) return 0;
+
+    back = buffer;
+    back_pitch = pitch;
+    vram = (uint8_t *)(uintptr_t)fb->addr;
+    front_pitch = fb->pitch;
+    screen_width = fb->width;
+    screen_height = fb->height;
+    bytes_per_pixel = 4;
+    build_palette(fb);
+    vga_reset_clip();
+    return 1;
 }
 
 static void vga_graphics_init(void) {
-    puts("[vga_graphics] Switching to Mode 13h (320x200)...\n");
-    set_mode_13h();
+    char buf[32];
+    const struct boot_framebuffer *fb = multiboot_get_framebuffer();
+    if (fb && init_lfb(fb)) {
+        puts("[vga_graphics] Linear framebuffer ");
+        itoa_u(screen_width, buf);
+        puts(buf);
+        puts("x");
+        itoa_u(screen_height, buf);
+        puts(buf);
+        puts("x32\n");
+    } else {
+        puts("[vga_graphics] Switching to Mode 13h (320x200)...\n");
+        set_mode_13h();
+    }
     vga_clear_screen(0x00); // Black
     
     // Test pattern
     vga_fill_rect(10, 10, 100, 50, 0x0F); // White
     vga_draw_rect(120, 10, 100, 50, 0x0C); // Red outline
     vga_draw_line(10, 70, 310, 70, 0x0A); // Green line
+    vga_flush();
     
     puts("[vga_graphics] Graphics mode initialized\n");
 }
 
-static void vga_graphics_tick(void) {
-    // Nothing to do each tick for now
-}
-
 __attribute__((section(".compobjs"))) static struct component vga_graphics_component = {
     .name = "vga_graphics",
     .init = vga_graphics_init,
-    .tick = vga_graphics_tick
+    .tick = NULL,
+    .deps = (const char *const[]){ "memory", NULL },
+    .priority = 10  // Leaves text mode, so after the components that log at boot
 };
 
 __attribute__((section(".comps"))) struct component *p_vga_graphics_component = &vga_graphics_component;